@@ -0,0 +1,131 @@
+#include "qdomcompatasync_p.h"
+
+#include <QBuffer>
+#include <QThreadPool>
+
+static int countNodes(const QDomNode &root)
+{
+    int count = 0;
+    QDomNode node = root;
+    while(!node.isNull()){
+        count++;
+        if(node.hasChildNodes()){
+            node = node.firstChild();
+            continue;
+        }
+        while(node != root && node.nextSibling().isNull()){
+            node = node.parentNode();
+        }
+        if(node == root){
+            break;
+        }
+        node = node.nextSibling();
+    }
+    return count;
+}
+
+QDomCompatParseTask::QDomCompatParseTask(const QDomDocumentCompat &options, const QByteArray &data, bool namespaceProcessing)
+    : compactThreshold(options.compactTextThreshold())
+    , compression(options.compression())
+    , indexEnabled(options.isElementIndexEnabled())
+    , idAttributes(options.idAttributes())
+    , limits(options.parseLimits())
+    , whitespace(options.whitespacePolicy())
+    , data(data)
+    , namespaceProcessing(namespaceProcessing)
+{
+}
+
+QFuture<QDomCompatParseResult> QDomCompatParseTask::start(QThreadPool *pool)
+{
+    futureInterface.reportStarted();
+    QFuture<QDomCompatParseResult> future = futureInterface.future();
+    (pool != nullptr ? pool : QThreadPool::globalInstance())->start(this);
+    return future;
+}
+
+void QDomCompatParseTask::run()
+{
+    if(futureInterface.isCanceled()){
+        futureInterface.reportFinished();
+        return;
+    }
+
+    QDomCompatParseResult result;
+    {
+        QDomDocumentCompat doc;
+        doc.setCompactTextThreshold(compactThreshold);
+        doc.setCompression(compression);
+        doc.setElementIndexEnabled(indexEnabled);
+        doc.setIdAttributes(idAttributes);
+        doc.setParseLimits(limits);
+        doc.setWhitespacePolicy(whitespace);
+
+        //progress counts the bytes read, compressed or not
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        futureInterface.setProgressRange(0, data.size());
+        QDomCompatFutureProgress<QDomCompatParseResult> progress(&futureInterface, &buffer, data.size());
+        doc.progress = &progress;
+        result.ok = doc.setContent(&buffer, namespaceProcessing, &result.errorMsg, &result.errorLine, &result.errorColumn);
+        doc.progress = nullptr;
+
+        if(result.ok){
+            futureInterface.setProgressValue(data.size());
+            result.document = doc;
+        }
+    }
+
+    //dropped by the future if it was canceled meanwhile
+    futureInterface.reportResult(result);
+    futureInterface.reportFinished();
+}
+
+QDomCompatSaveTask::QDomCompatSaveTask(const QDomDocumentCompat &document, QIODevice *device, int indent)
+    : document(document)
+    , device(device)
+    , indent(indent)
+{
+}
+
+QFuture<QDomCompatSaveResult> QDomCompatSaveTask::start(QThreadPool *pool)
+{
+    futureInterface.reportStarted();
+    QFuture<QDomCompatSaveResult> future = futureInterface.future();
+    (pool != nullptr ? pool : QThreadPool::globalInstance())->start(this);
+    return future;
+}
+
+void QDomCompatSaveTask::run()
+{
+    if(futureInterface.isCanceled()){
+        futureInterface.reportFinished();
+        return;
+    }
+
+    QDomCompatSaveResult result;
+    const int total = countNodes(document);
+    futureInterface.setProgressRange(0, total);
+    QDomCompatFutureProgress<QDomCompatSaveResult> progress(&futureInterface, nullptr, total);
+
+    {
+        //compressed as set on the document
+        QString errorString;
+        document.progress = &progress;
+        const bool ok = document.save(device, indent, &errorString);
+        document.progress = nullptr;
+
+        if(progress.isCanceled()){
+            result.errorString = QStringLiteral("Canceled");
+        }else if(!ok){
+            result.errorString = errorString;
+        }else{
+            result.ok = true;
+            futureInterface.setProgressValue(total);
+        }
+    }
+
+    futureInterface.reportResult(result);
+    futureInterface.reportFinished();
+}
@@ -0,0 +1,99 @@
+#ifndef QDOMCOMPATASYNC_P_H
+#define QDOMCOMPATASYNC_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+#include <QFutureInterface>
+#include <QRunnable>
+
+// Called once per node by the parse handler and the save walk.
+class QDomCompatProgress
+{
+public:
+    virtual ~QDomCompatProgress() {}
+
+    // Returns false to stop.
+    virtual bool step() = 0;
+};
+
+// Forwards cancellation and, every Interval nodes, progress to a future.
+// The progress value is the read position of `device`, or the node count without one.
+template <typename T>
+class QDomCompatFutureProgress : public QDomCompatProgress
+{
+public:
+    QDomCompatFutureProgress(QFutureInterface<T> *futureInterface, const QIODevice *device, int maximum)
+        : futureInterface(futureInterface)
+        , device(device)
+        , maximum(maximum)
+        , count(0)
+        , canceled(false)
+    {
+    }
+
+    bool step() override
+    {
+        if(futureInterface->isCanceled()){
+            canceled = true;
+            return false;
+        }
+        if(++count % Interval == 0){
+            const qint64 value = device != nullptr ? device->pos() : count;
+            futureInterface->setProgressValue(int(qMin(value, qint64(maximum))));
+        }
+        return true;
+    }
+
+    bool isCanceled() const
+    {
+        return canceled;
+    }
+
+private:
+    enum { Interval = 256 };
+
+    QFutureInterface<T> *futureInterface;
+    const QIODevice *device;
+    int maximum;
+    qint64 count;
+    bool canceled;
+};
+
+class QDomCompatParseTask : public QRunnable
+{
+public:
+    QDomCompatParseTask(const QDomDocumentCompat &options, const QByteArray &data, bool namespaceProcessing);
+
+    QFuture<QDomCompatParseResult> start(QThreadPool *pool);
+    void run() override;
+
+private:
+    QFutureInterface<QDomCompatParseResult> futureInterface;
+    //option values only, a document copy would share the caller's tree and stores
+    int compactThreshold;
+    QDomDocumentCompat::Compression compression;
+    bool indexEnabled;
+    QStringList idAttributes;
+    QDomCompatParseLimits limits;
+    QDomDocumentCompat::WhitespacePolicy whitespace;
+    QByteArray data;
+    bool namespaceProcessing;
+};
+
+class QDomCompatSaveTask : public QRunnable
+{
+public:
+    QDomCompatSaveTask(const QDomDocumentCompat &document, QIODevice *device, int indent);
+
+    QFuture<QDomCompatSaveResult> start(QThreadPool *pool);
+    void run() override;
+
+private:
+    QFutureInterface<QDomCompatSaveResult> futureInterface;
+    QDomDocumentCompat document;    // shares the caller's tree, walked on the pool thread
+    QIODevice *device;
+    int indent;
+};
+
+#endif // QDOMCOMPATASYNC_P_H
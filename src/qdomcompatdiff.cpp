@@ -0,0 +1,397 @@
+#include "qdomcompatdiff_p.h"
+#include "qdomcompatdigest_p.h"
+#include "qdomcompattext_p.h"
+
+#include <QMap>
+
+// Candidates of one parent sharing a digest or a key, handed out in document order.
+struct QDomCompatDiffSlots {
+    QVector<int> list;
+    int next;
+
+    QDomCompatDiffSlots() : next(0) {}
+
+    int take()
+    {
+        return next < list.size() ? list.at(next++) : -1;
+    }
+};
+
+//Marks one longest strictly increasing subsequence of list (patience sorting, O(n log n)).
+static QVector<bool> longestIncreasing(const QVector<int> &list)
+{
+    QVector<int> tails;
+    QVector<int> previous(list.size(), -1);
+
+    for(int i=0; i<list.size(); i++){
+        int low = 0;
+        int high = tails.size();
+        while(low < high){
+            const int middle = (low + high) / 2;
+            if(list.at(tails.at(middle)) < list.at(i)){
+                low = middle + 1;
+            }else{
+                high = middle;
+            }
+        }
+        if(low > 0){
+            previous[i] = tails.at(low - 1);
+        }
+        if(low == tails.size()){
+            tails.append(i);
+        }else{
+            tails[low] = i;
+        }
+    }
+
+    QVector<bool> kept(list.size(), false);
+    for(int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous.at(i)){
+        kept[i] = true;
+    }
+    return kept;
+}
+
+//Attributes keyed by namespace URI and local name as the digests resolve them,
+//namespace declarations left out.
+static QMap<QString, QDomNode> canonicalAttributes(const QDomNode &node)
+{
+    QMap<QString, QDomNode> map;
+    QDomCompatDigester names(QCryptographicHash::Md5);
+    names.setScope(node);
+    const QDomNamedNodeMap attrs = node.attributes();
+    const int attr_count = attrs.count();
+    for(int i=0; i<attr_count; i++){
+        const QDomNode attr = attrs.item(i);
+        if(attr.namespaceURI() == QLatin1String("http://www.w3.org/2000/xmlns/") || QDomCompatDigester::isDeclaration(attr)){
+            continue;
+        }
+        QString namespaceURI;
+        QString name;
+        names.resolvedName(attr, &namespaceURI, &name);
+        map.insert(QLatin1Char('{') + namespaceURI + QLatin1Char('}') + name, attr);
+    }
+    return map;
+}
+
+QDomCompatDiffer::QDomCompatDiffer(QDomDocumentCompat::DiffOptions options, const QDomCompatTextStore *oldStore, const QDomCompatTextStore *newStore)
+    : options(options)
+    , oldStore(oldStore)
+    , newStore(newStore)
+{
+}
+
+QVector<QDomCompatDifference> QDomCompatDiffer::diff(const QDomNode &oldRoot, const QDomNode &newRoot)
+{
+    differences.clear();
+    digests.clear();
+
+    build(oldRoot, &oldTree, oldStore);
+    build(newRoot, &newTree, newStore);
+
+    QVector<int> oldRoots;
+    QVector<int> newRoots;
+    if(!oldTree.entries.isEmpty()){
+        oldRoots.append(0);
+    }
+    if(!newTree.entries.isEmpty()){
+        newRoots.append(0);
+    }
+    const QVector<QString> oldSteps = oldRoot.isDocument() ? QVector<QString>(oldRoots.size()) : steps(oldTree, oldRoots);
+    const QVector<QString> newSteps = newRoot.isDocument() ? QVector<QString>(newRoots.size()) : steps(newTree, newRoots);
+
+    if(!oldRoots.isEmpty() && !newRoots.isEmpty() && key(oldRoot) == key(newRoot)){
+        compare(0, 0, oldSteps.first(), newSteps.first());
+    }else{
+        if(!oldRoots.isEmpty()){
+            append(QDomCompatDifference::Removed, oldSteps.first(), QString(), oldRoot, QDomNode(), oldTree.entries.first().digest);
+        }
+        if(!newRoots.isEmpty()){
+            append(QDomCompatDifference::Inserted, QString(), newSteps.first(), QDomNode(), newRoot, newTree.entries.first().digest);
+        }
+    }
+
+    detectMoves();
+
+    oldTree = QDomCompatDiffTree();
+    newTree = QDomCompatDiffTree();
+    digests.clear();
+    return differences;
+}
+
+void QDomCompatDiffer::build(const QDomNode &root, QDomCompatDiffTree *tree, const QDomCompatTextStore *store) const
+{
+    //MD5 is only used to find equal subtrees here, not as a signature
+    QDomCompatDigester digester(QCryptographicHash::Md5);
+    digester.setIgnoreWhitespaceText(options.testFlag(QDomDocumentCompat::DiffIgnoreWhitespaceText));
+    digester.setTextStore(store);
+
+    tree->entries.clear();
+    digester.digest(root, &tree->entries);
+
+    const int count = tree->entries.size();
+    tree->end.fill(count, count);
+
+    //an entry ends where the next entry at the same or a lower depth starts
+    QVector<int> stack;
+    for(int i=0; i<count; i++){
+        const int depth = tree->entries.at(i).depth;
+        while(!stack.isEmpty() && tree->entries.at(stack.last()).depth >= depth){
+            tree->end[stack.takeLast()] = i;
+        }
+        stack.append(i);
+    }
+}
+
+void QDomCompatDiffer::compare(int oldIndex, int newIndex, const QString &oldPath, const QString &newPath)
+{
+    const QDomCompatSubtreeDigest &oldEntry = oldTree.entries.at(oldIndex);
+    const QDomCompatSubtreeDigest &newEntry = newTree.entries.at(newIndex);
+
+    if(oldEntry.digest == newEntry.digest){
+        //identical subtrees, nothing below needs a look
+        return;
+    }
+
+    if(oldEntry.node.isElement()){
+        compareAttributes(oldEntry.node, newEntry.node, oldPath, newPath);
+
+    }else if(!oldEntry.node.isDocument() && !oldEntry.node.isDocumentFragment() && !oldEntry.node.isEntityReference()){
+        //text, comment or processing instruction with another value
+        QDomCompatDifference &difference = append(QDomCompatDifference::Changed, oldPath, newPath,
+                                                  oldEntry.node, newEntry.node, QByteArray());
+        difference.oldValue = oldStore != nullptr ? oldStore->text(oldEntry.node) : oldEntry.node.nodeValue();
+        difference.newValue = newStore != nullptr ? newStore->text(newEntry.node) : newEntry.node.nodeValue();
+        return;
+    }
+
+    const QVector<int> oldChildren = children(oldTree, oldIndex);
+    const QVector<int> newChildren = children(newTree, newIndex);
+    const QVector<QString> oldSteps = steps(oldTree, oldChildren);
+    const QVector<QString> newSteps = steps(newTree, newChildren);
+    QVector<int> oldMatch(oldChildren.size(), -1);
+    QVector<int> newMatch(newChildren.size(), -1);
+
+    //identical subtrees first
+    QHash<QByteArray, QDomCompatDiffSlots> byDigest;
+    for(int j=0; j<newChildren.size(); j++){
+        byDigest[newTree.entries.at(newChildren.at(j)).digest].list.append(j);
+    }
+    QVector<int> matchedOld;
+    QVector<int> matchedNew;
+    for(int i=0; i<oldChildren.size(); i++){
+        QHash<QByteArray, QDomCompatDiffSlots>::iterator it = byDigest.find(oldTree.entries.at(oldChildren.at(i)).digest);
+        if(it == byDigest.end()){
+            continue;
+        }
+        const int j = it->take();
+        if(j >= 0){
+            oldMatch[i] = j;
+            newMatch[j] = i;
+            matchedOld.append(i);
+            matchedNew.append(j);
+        }
+    }
+
+    //the largest set keeping its relative order stays, the others were moved
+    const QVector<bool> kept = longestIncreasing(matchedNew);
+    for(int k=0; k<kept.size(); k++){
+        if(!kept.at(k)){
+            const int i = matchedOld.at(k);
+            const int j = matchedNew.at(k);
+            append(QDomCompatDifference::Moved, oldPath + oldSteps.at(i), newPath + newSteps.at(j),
+                   oldTree.entries.at(oldChildren.at(i)).node, newTree.entries.at(newChildren.at(j)).node, QByteArray());
+        }
+    }
+
+    //then the rest in document order by kind and name, and look inside
+    QHash<QString, QDomCompatDiffSlots> byKey;
+    for(int j=0; j<newChildren.size(); j++){
+        if(newMatch.at(j) < 0){
+            byKey[key(newTree.entries.at(newChildren.at(j)).node)].list.append(j);
+        }
+    }
+    for(int i=0; i<oldChildren.size(); i++){
+        if(oldMatch.at(i) >= 0){
+            continue;
+        }
+        QHash<QString, QDomCompatDiffSlots>::iterator it = byKey.find(key(oldTree.entries.at(oldChildren.at(i)).node));
+        if(it == byKey.end()){
+            continue;
+        }
+        const int j = it->take();
+        if(j >= 0){
+            oldMatch[i] = j;
+            newMatch[j] = i;
+            compare(oldChildren.at(i), newChildren.at(j), oldPath + oldSteps.at(i), newPath + newSteps.at(j));
+        }
+    }
+
+    for(int i=0; i<oldChildren.size(); i++){
+        if(oldMatch.at(i) < 0){
+            const QDomCompatSubtreeDigest &entry = oldTree.entries.at(oldChildren.at(i));
+            append(QDomCompatDifference::Removed, oldPath + oldSteps.at(i), QString(), entry.node, QDomNode(), entry.digest);
+        }
+    }
+    for(int j=0; j<newChildren.size(); j++){
+        if(newMatch.at(j) < 0){
+            const QDomCompatSubtreeDigest &entry = newTree.entries.at(newChildren.at(j));
+            append(QDomCompatDifference::Inserted, QString(), newPath + newSteps.at(j), QDomNode(), entry.node, entry.digest);
+        }
+    }
+}
+
+void QDomCompatDiffer::compareAttributes(const QDomNode &oldNode, const QDomNode &newNode, const QString &oldPath, const QString &newPath)
+{
+    const QMap<QString, QDomNode> oldAttrs = canonicalAttributes(oldNode);
+    const QMap<QString, QDomNode> newAttrs = canonicalAttributes(newNode);
+
+    for(QMap<QString, QDomNode>::const_iterator it = oldAttrs.constBegin(); it != oldAttrs.constEnd(); ++it){
+        const QDomNode &oldAttr = it.value();
+        QMap<QString, QDomNode>::const_iterator found = newAttrs.constFind(it.key());
+        if(found == newAttrs.constEnd()){
+            QDomCompatDifference &difference = append(QDomCompatDifference::AttributeRemoved,
+                                                      oldPath + QStringLiteral("/@") + oldAttr.nodeName(), newPath,
+                                                      oldNode, newNode, QByteArray());
+            difference.attributeName = oldAttr.nodeName();
+            difference.oldValue = oldAttr.nodeValue();
+        }else if(oldAttr.nodeValue() != found.value().nodeValue()){
+            const QDomNode &newAttr = found.value();
+            QDomCompatDifference &difference = append(QDomCompatDifference::AttributeChanged,
+                                                      oldPath + QStringLiteral("/@") + oldAttr.nodeName(),
+                                                      newPath + QStringLiteral("/@") + newAttr.nodeName(),
+                                                      oldNode, newNode, QByteArray());
+            difference.attributeName = newAttr.nodeName();
+            difference.oldValue = oldAttr.nodeValue();
+            difference.newValue = newAttr.nodeValue();
+        }
+    }
+    for(QMap<QString, QDomNode>::const_iterator it = newAttrs.constBegin(); it != newAttrs.constEnd(); ++it){
+        if(!oldAttrs.contains(it.key())){
+            const QDomNode &newAttr = it.value();
+            QDomCompatDifference &difference = append(QDomCompatDifference::AttributeInserted,
+                                                      oldPath, newPath + QStringLiteral("/@") + newAttr.nodeName(),
+                                                      oldNode, newNode, QByteArray());
+            difference.attributeName = newAttr.nodeName();
+            difference.newValue = newAttr.nodeValue();
+        }
+    }
+}
+
+QDomCompatDifference &QDomCompatDiffer::append(QDomCompatDifference::Type type, const QString &oldPath, const QString &newPath,
+                                               const QDomNode &oldNode, const QDomNode &newNode, const QByteArray &digest)
+{
+    QDomCompatDifference difference;
+    difference.type = type;
+    difference.oldPath = oldPath;
+    difference.newPath = newPath;
+    difference.oldNode = oldNode;
+    difference.newNode = newNode;
+    differences.append(difference);
+    digests.append(digest);
+    return differences.last();
+}
+
+//A subtree removed in one place and inserted unchanged in another was moved.
+void QDomCompatDiffer::detectMoves()
+{
+    QHash<QByteArray, QDomCompatDiffSlots> removed;
+    for(int i=0; i<differences.size(); i++){
+        if(differences.at(i).type == QDomCompatDifference::Removed){
+            removed[digests.at(i)].list.append(i);
+        }
+    }
+    if(removed.isEmpty()){
+        return;
+    }
+
+    QVector<bool> dropped(differences.size(), false);
+    for(int i=0; i<differences.size(); i++){
+        if(differences.at(i).type != QDomCompatDifference::Inserted){
+            continue;
+        }
+        QHash<QByteArray, QDomCompatDiffSlots>::iterator it = removed.find(digests.at(i));
+        if(it == removed.end()){
+            continue;
+        }
+        const int r = it->take();
+        if(r >= 0){
+            QDomCompatDifference &difference = differences[i];
+            difference.type = QDomCompatDifference::Moved;
+            difference.oldPath = differences.at(r).oldPath;
+            difference.oldNode = differences.at(r).oldNode;
+            dropped[r] = true;
+        }
+    }
+
+    QVector<QDomCompatDifference> list;
+    list.reserve(differences.size());
+    for(int i=0; i<differences.size(); i++){
+        if(!dropped.at(i)){
+            list.append(differences.at(i));
+        }
+    }
+    differences = list;
+}
+
+QVector<int> QDomCompatDiffer::children(const QDomCompatDiffTree &tree, int index) const
+{
+    QVector<int> list;
+    for(int child = index + 1; child < tree.end.at(index); child = tree.end.at(child)){
+        list.append(child);
+    }
+    return list;
+}
+
+//XPath like location steps, the position counted among siblings of the same name or kind.
+QVector<QString> QDomCompatDiffer::steps(const QDomCompatDiffTree &tree, const QVector<int> &list) const
+{
+    QHash<QString, int> positions;
+    QVector<QString> result;
+    result.reserve(list.size());
+
+    for(int index: list){
+        const QDomNode &node = tree.entries.at(index).node;
+        QString name;
+        if(node.isElement() || node.isEntityReference()){
+            name = node.nodeName();
+        }else if(node.isText() || node.isCDATASection()){
+            name = QStringLiteral("text()");
+        }else if(node.isComment()){
+            name = QStringLiteral("comment()");
+        }else if(node.isProcessingInstruction()){
+            name = QStringLiteral("processing-instruction('") + node.nodeName() + QStringLiteral("')");
+        }else{
+            name = QStringLiteral("node()");
+        }
+        const int position = ++positions[name];
+        result.append(QLatin1Char('/') + name + QLatin1Char('[') + QString::number(position) + QLatin1Char(']'));
+    }
+    return result;
+}
+
+//Children with the same key are compared with each other instead of being removed and inserted.
+QString QDomCompatDiffer::key(const QDomNode &node) const
+{
+    if(node.isElement()){
+        QString namespaceURI;
+        QString name;
+        QDomCompatDigester names(QCryptographicHash::Md5);
+        if(node.localName().isNull()){
+            //without namespace processing the prefix is resolved like the digests do
+            names.setScope(node);
+        }
+        names.resolvedName(node, &namespaceURI, &name);
+        return QStringLiteral("E{") + namespaceURI + QLatin1Char('}') + name;
+    }else if(node.isText() || node.isCDATASection()){
+        return QStringLiteral("T");
+    }else if(node.isComment()){
+        return QStringLiteral("C");
+    }else if(node.isProcessingInstruction()){
+        return QStringLiteral("P") + node.nodeName();
+    }else if(node.isEntityReference()){
+        return QStringLiteral("R") + node.nodeName();
+    }else if(node.isDocument()){
+        return QStringLiteral("D");
+    }
+    return QStringLiteral("F");
+}
@@ -0,0 +1,43 @@
+#ifndef QDOMCOMPATDIFF_P_H
+#define QDOMCOMPATDIFF_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+
+// Pre-order mirror of a tree with the canonical digest of every subtree.
+// The children of entry i are i + 1, end[i + 1], ... up to end[i].
+struct QDomCompatDiffTree {
+    QVector<QDomCompatSubtreeDigest> entries;
+    QVector<int> end;
+};
+
+class QDomCompatDiffer
+{
+public:
+    QDomCompatDiffer(QDomDocumentCompat::DiffOptions options, const QDomCompatTextStore *oldStore, const QDomCompatTextStore *newStore);
+
+    QVector<QDomCompatDifference> diff(const QDomNode &oldRoot, const QDomNode &newRoot);
+
+private:
+    QDomDocumentCompat::DiffOptions options;
+    const QDomCompatTextStore *oldStore;   // compact text of either side, may be null
+    const QDomCompatTextStore *newStore;
+    QDomCompatDiffTree oldTree;
+    QDomCompatDiffTree newTree;
+    QVector<QDomCompatDifference> differences;
+    QVector<QByteArray> digests;    // subtree digest of each difference, for moves across parents
+
+    void build(const QDomNode &root, QDomCompatDiffTree *tree, const QDomCompatTextStore *store) const;
+    void compare(int oldIndex, int newIndex, const QString &oldPath, const QString &newPath);
+    void compareAttributes(const QDomNode &oldNode, const QDomNode &newNode, const QString &oldPath, const QString &newPath);
+    QDomCompatDifference &append(QDomCompatDifference::Type type, const QString &oldPath, const QString &newPath,
+                const QDomNode &oldNode, const QDomNode &newNode, const QByteArray &digest);
+    void detectMoves();
+
+    QVector<int> children(const QDomCompatDiffTree &tree, int index) const;
+    QVector<QString> steps(const QDomCompatDiffTree &tree, const QVector<int> &list) const;
+    QString key(const QDomNode &node) const;
+};
+
+#endif // QDOMCOMPATDIFF_P_H
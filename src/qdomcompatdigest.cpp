@@ -0,0 +1,308 @@
+#include "qdomcompatdigest_p.h"
+#include "qdomcompattext_p.h"
+
+#include <QStringView>
+
+#include <algorithm>
+
+struct QDomCompatCanonicalAttribute {
+    QString namespaceURI;
+    QString name;
+    QString value;
+
+    bool operator<(const QDomCompatCanonicalAttribute &other) const
+    {
+        if(namespaceURI != other.namespaceURI){
+            return namespaceURI < other.namespaceURI;
+        }
+        return name < other.name;
+    }
+};
+
+static bool isWhitespace(const QString &text)
+{
+    for(const QChar &ch: text){
+        if(ch != QLatin1Char(' ') && ch != QLatin1Char('\t') && ch != QLatin1Char('\r') && ch != QLatin1Char('\n')){
+            return false;
+        }
+    }
+    return true;
+}
+
+QDomCompatHashDevice::QDomCompatHashDevice(QCryptographicHash *hash)
+    : QIODevice()
+    , hash(hash)
+{
+    Q_ASSERT(hash);
+}
+
+bool QDomCompatHashDevice::isSequential() const
+{
+    return true;
+}
+
+qint64 QDomCompatHashDevice::readData(char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+}
+
+qint64 QDomCompatHashDevice::writeData(const char *data, qint64 maxSize)
+{
+    hash->addData(QByteArray::fromRawData(data, int(maxSize)));
+    return maxSize;
+}
+
+QDomCompatDigester::QDomCompatDigester(QCryptographicHash::Algorithm algorithm)
+    : algorithm(algorithm)
+    , ignoreWhitespaceText(false)
+    , textStore(nullptr)
+{
+}
+
+void QDomCompatDigester::setIgnoreWhitespaceText(bool ignore)
+{
+    ignoreWhitespaceText = ignore;
+}
+
+void QDomCompatDigester::setTextStore(const QDomCompatTextStore *store)
+{
+    textStore = store;
+}
+
+bool QDomCompatDigester::isDigested(const QDomNode &node) const
+{
+    if(node.isCDATASection()){
+        return true;
+    }else if(node.isText()){
+        return !ignoreWhitespaceText || !isWhitespace(textValue(node));
+    }
+    return node.isElement() || node.isComment()
+            || node.isProcessingInstruction() || node.isEntityReference()
+            || node.isDocument() || node.isDocumentFragment();
+}
+
+void QDomCompatDigester::canonicalName(const QDomNode &node, QString *namespaceURI, QString *name)
+{
+    //Nodes created without namespace processing have no local name.
+    if(node.localName().isNull()){
+        *namespaceURI = QString();
+        *name = node.nodeName();
+    }else{
+        *namespaceURI = node.namespaceURI();
+        *name = node.localName();
+    }
+}
+
+QByteArray QDomCompatDigester::digest(const QDomNode &node, QVector<QDomCompatSubtreeDigest> *subtrees)
+{
+    if(!isDigested(node)){
+        return QByteArray();
+    }
+
+    //the declarations of the ancestors are in scope for a subtree
+    setScope(node.parentNode());
+    return digest(node, 0, subtrees);
+}
+
+void QDomCompatDigester::setScope(const QDomNode &element)
+{
+    scope.clear();
+    QVector<QDomNode> elements;
+    for(QDomNode parent = element; parent.isElement(); parent = parent.parentNode()){
+        elements.append(parent);
+    }
+    for(int i=elements.size() - 1; i>=0; i--){
+        declare(elements.at(i));
+    }
+}
+
+//An xmlns attribute of a tree parsed without namespace processing.
+bool QDomCompatDigester::isDeclaration(const QDomNode &attr)
+{
+    if(!attr.localName().isNull()){
+        return false;
+    }
+    const QString name = attr.nodeName();
+    return name == QLatin1String("xmlns") || name.startsWith(QLatin1String("xmlns:"));
+}
+
+//Pushes the declarations of an element without namespace processing onto the scope.
+int QDomCompatDigester::declare(const QDomNode &element)
+{
+    int count = 0;
+    const QDomNamedNodeMap attrs = element.attributes();
+    const int attr_count = attrs.count();
+    for(int i=0; i<attr_count; i++){
+        const QDomNode attr = attrs.item(i);
+        if(isDeclaration(attr)){
+            const QString name = attr.nodeName();
+            scope.append(qMakePair(name.size() > 5 ? name.mid(6) : QString(), attr.nodeValue()));
+            count++;
+        }
+    }
+    return count;
+}
+
+//Namespace URI and local name, through the declarations in scope for nodes without a local name.
+void QDomCompatDigester::resolvedName(const QDomNode &node, QString *namespaceURI, QString *name) const
+{
+    if(!node.localName().isNull()){
+        *namespaceURI = node.namespaceURI();
+        *name = node.localName();
+        return;
+    }
+
+    const QString qualifiedName = node.nodeName();
+    const int colon = qualifiedName.indexOf(QLatin1Char(':'));
+    *namespaceURI = QString();
+    *name = qualifiedName;
+    if(colon < 0 && node.isAttr()){
+        //unprefixed attributes are in no namespace
+        return;
+    }
+
+    const QString prefix = colon < 0 ? QString() : qualifiedName.left(colon);
+    if(prefix == QLatin1String("xml")){
+        *namespaceURI = QStringLiteral("http://www.w3.org/XML/1998/namespace");
+        *name = qualifiedName.mid(colon + 1);
+        return;
+    }
+    for(int i=scope.size() - 1; i>=0; i--){
+        if(scope.at(i).first == prefix){
+            *namespaceURI = scope.at(i).second;
+            *name = qualifiedName.mid(colon + 1);
+            return;
+        }
+    }
+    //an undeclared prefix stays part of the name
+}
+
+QByteArray QDomCompatDigester::digest(const QDomNode &node, int depth, QVector<QDomCompatSubtreeDigest> *subtrees)
+{
+    //pre-order slot, filled in once the children are done
+    int index = -1;
+    if(subtrees != nullptr){
+        QDomCompatSubtreeDigest entry;
+        entry.node = node;
+        entry.depth = depth;
+        index = subtrees->size();
+        subtrees->append(entry);
+    }
+
+    const int declared = node.isElement() ? declare(node) : 0;
+    QCryptographicHash hash(algorithm);
+    addHeader(hash, node);
+
+    quint32 count = 0;
+    for(QDomNode child = node.firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(isDigested(child)){
+            hash.addData(digest(child, depth + 1, subtrees));
+            count++;
+        }
+    }
+    addNumber(hash, count);
+    scope.resize(scope.size() - declared);
+
+    const QByteArray result = hash.result();
+    if(index >= 0){
+        (*subtrees)[index].digest = result;
+    }
+    return result;
+}
+
+void QDomCompatDigester::addHeader(QCryptographicHash &hash, const QDomNode &node) const
+{
+    QString namespaceURI;
+    QString name;
+
+    if(node.isElement()){
+        hash.addData(QByteArray::fromRawData("E", 1));
+        resolvedName(node, &namespaceURI, &name);
+        addString(hash, namespaceURI);
+        addString(hash, name);
+
+        QVector<QDomCompatCanonicalAttribute> list;
+        const QDomNamedNodeMap attrs = node.attributes();
+        const int attr_count = attrs.count();
+        list.reserve(attr_count);
+        for(int i=0; i<attr_count; i++){
+            const QDomNode attr = attrs.item(i);
+            if(attr.namespaceURI() == QLatin1String("http://www.w3.org/2000/xmlns/") || isDeclaration(attr)){
+                //namespace declarations are normalized into the names
+                continue;
+            }
+            QDomCompatCanonicalAttribute canonical;
+            resolvedName(attr, &canonical.namespaceURI, &canonical.name);
+            canonical.value = attr.nodeValue();
+            list.append(canonical);
+        }
+        std::sort(list.begin(), list.end());
+
+        addNumber(hash, quint32(list.size()));
+        for(const QDomCompatCanonicalAttribute &attr: list){
+            addString(hash, attr.namespaceURI);
+            addString(hash, attr.name);
+            addString(hash, attr.value);
+        }
+
+    }else if(node.isText() || node.isCDATASection()){
+        //CDATA sections are text with a different notation
+        hash.addData(QByteArray::fromRawData("T", 1));
+        addString(hash, textValue(node));
+
+    }else if(node.isComment()){
+        hash.addData(QByteArray::fromRawData("C", 1));
+        addString(hash, node.nodeValue());
+
+    }else if(node.isProcessingInstruction()){
+        hash.addData(QByteArray::fromRawData("P", 1));
+        addString(hash, node.nodeName());
+        addString(hash, node.nodeValue());
+
+    }else if(node.isEntityReference()){
+        hash.addData(QByteArray::fromRawData("R", 1));
+        addString(hash, node.nodeName());
+
+    }else if(node.isDocument()){
+        hash.addData(QByteArray::fromRawData("D", 1));
+
+    }else if(node.isDocumentFragment()){
+        hash.addData(QByteArray::fromRawData("F", 1));
+    }
+}
+
+void QDomCompatDigester::addNumber(QCryptographicHash &hash, quint32 number) const
+{
+    const char bytes[4] = {
+        char((number >> 24) & 0xff),
+        char((number >> 16) & 0xff),
+        char((number >> 8) & 0xff),
+        char(number & 0xff)
+    };
+    hash.addData(QByteArray::fromRawData(bytes, 4));
+}
+
+void QDomCompatDigester::addString(QCryptographicHash &hash, const QString &text) const
+{
+    //length prefixed, encoded in small chunks so that large text never gets a full UTF-8 copy
+    addNumber(hash, quint32(text.size()));
+
+    const QStringView view(text);
+    int pos = 0;
+    while(pos < view.size()){
+        int length = qMin(int(ChunkSize), int(view.size()) - pos);
+        if(pos + length < view.size() && view.at(pos + length - 1).isHighSurrogate()){
+            //don't split a surrogate pair
+            length--;
+        }
+        hash.addData(view.mid(pos, length).toUtf8());
+        pos += length;
+    }
+}
+
+QString QDomCompatDigester::textValue(const QDomNode &node) const
+{
+    return textStore != nullptr ? textStore->text(node) : node.nodeValue();
+}
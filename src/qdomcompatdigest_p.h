@@ -0,0 +1,71 @@
+#ifndef QDOMCOMPATDIGEST_P_H
+#define QDOMCOMPATDIGEST_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+#include <QCryptographicHash>
+#include <QIODevice>
+#include <QPair>
+
+// Write-only device that feeds everything written to it into a hash.
+// QTextStream's write buffer in front of it is the only copy of the output.
+class QDomCompatHashDevice : public QIODevice
+{
+public:
+    explicit QDomCompatHashDevice(QCryptographicHash *hash);
+
+    bool isSequential() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    QCryptographicHash *hash;
+};
+
+// Computes canonical digests bottom-up: a node's digest covers its own
+// canonical header (kind, namespace URI, local name, attributes sorted by
+// namespace URI and local name, value) followed by the digests of its children.
+// Prefixes, namespace declarations, the doctype and CDATA/text distinction
+// don't take part. Without namespace processing the prefixes are resolved
+// from the xmlns attributes in scope.
+class QDomCompatDigester
+{
+public:
+    explicit QDomCompatDigester(QCryptographicHash::Algorithm algorithm);
+
+    // Leaves whitespace-only text nodes out, as if they weren't there.
+    void setIgnoreWhitespaceText(bool ignore);
+    // Reads text and CDATA through the compact store of the document, if any.
+    void setTextStore(const QDomCompatTextStore *store);
+    bool isDigested(const QDomNode &node) const;
+
+    QByteArray digest(const QDomNode &node, QVector<QDomCompatSubtreeDigest> *subtrees = nullptr);
+
+    static void canonicalName(const QDomNode &node, QString *namespaceURI, QString *name);
+    static bool isDeclaration(const QDomNode &attr);
+
+    // Puts the declarations of the element, its own included, and of its ancestors in scope,
+    // so resolvedName() gives the names digest() uses for the element and its attributes.
+    void setScope(const QDomNode &element);
+    void resolvedName(const QDomNode &node, QString *namespaceURI, QString *name) const;
+
+private:
+    enum { ChunkSize = 1024 };
+
+    QCryptographicHash::Algorithm algorithm;
+    bool ignoreWhitespaceText;
+    const QDomCompatTextStore *textStore;
+    QVector<QPair<QString, QString>> scope;     // prefix and URI of xmlns attributes without namespace processing, innermost last
+
+    QByteArray digest(const QDomNode &node, int depth, QVector<QDomCompatSubtreeDigest> *subtrees);
+    int declare(const QDomNode &element);
+    void addHeader(QCryptographicHash &hash, const QDomNode &node) const;
+    void addNumber(QCryptographicHash &hash, quint32 number) const;
+    void addString(QCryptographicHash &hash, const QString &text) const;
+    QString textValue(const QDomNode &node) const;
+};
+
+#endif // QDOMCOMPATDIGEST_P_H
@@ -0,0 +1,702 @@
+#include "qdomcompatfrozen_p.h"
+#include "qdomcompatdigest_p.h"
+#include "qdomcompatwhitespace_p.h"
+
+#include <algorithm>
+
+static QString indexKey(const QString &namespaceURI, const QString &localName)
+{
+    return QLatin1Char('{') + namespaceURI + QLatin1Char('}') + localName;
+}
+
+static bool isCDATAMarkup(const QString &markup, const QString &value)
+{
+    return markup.size() == value.size() + 12
+            && markup.startsWith(QLatin1String("<![CDATA["))
+            && markup.endsWith(QLatin1String("]]>"))
+            && QStringView(markup).mid(9, value.size()) == value;
+}
+
+QDomCompatFrozenData::Node::Node()
+    : type(QDomNode::BaseNode)
+    , text(false)
+    , indented(false)
+    , parent(-1)
+    , firstChild(-1)
+    , lastChild(-1)
+    , nextSibling(-1)
+    , previousSibling(-1)
+    , end(-1)
+    , firstAttribute(-1)
+    , attributeCount(0)
+    , gaps(-1)
+{
+}
+
+QStringView QDomCompatFrozenData::view(const Span &span) const
+{
+    if(span.length < 0){
+        return QStringView();
+    }
+    return QStringView(chars.constData() + span.offset, span.length);
+}
+
+QString QDomCompatFrozenData::text(int index) const
+{
+    const Node &node = nodes.at(index);
+    if(node.text){
+        return view(node.value).toString();
+    }
+    //the subtree is a range of the array
+    QString result;
+    for(int i=index + 1; i<node.end; i++){
+        if(nodes.at(i).text){
+            const QStringView value = view(nodes.at(i).value);
+            result.append(value.data(), int(value.size()));
+        }
+    }
+    return result;
+}
+
+int QDomCompatFrozenData::attribute(int element, QStringView qualifiedName) const
+{
+    const Node &node = nodes.at(element);
+    for(int i=node.firstAttribute; i<node.firstAttribute + node.attributeCount; i++){
+        if(view(nodes.at(i).name) == qualifiedName){
+            return i;
+        }
+    }
+    return -1;
+}
+
+int QDomCompatFrozenData::attributeNS(int element, QStringView namespaceURI, QStringView localName) const
+{
+    const Node &node = nodes.at(element);
+    for(int i=node.firstAttribute; i<node.firstAttribute + node.attributeCount; i++){
+        const Node &attr = nodes.at(i);
+        if(attr.localName.length >= 0 && view(attr.namespaceURI) == namespaceURI && view(attr.localName) == localName){
+            return i;
+        }
+    }
+    return -1;
+}
+
+//Same layout as QDomDocumentCompat::saveNode(). Elements are written from their start
+//tag and their children in the array, other nodes from their value or stored markup.
+void QDomCompatFrozenData::save(QTextStream &s, int index, int depth, int indent) const
+{
+    const Node &node = nodes.at(index);
+    if(node.type == QDomNode::DocumentNode){
+        bool first = true;
+        for(int child = node.firstChild; child >= 0; child = nodes.at(child).nextSibling){
+            if(first && nodes.at(child).type != QDomNode::ProcessingInstructionNode){
+                s << view(doctype);
+                first = false;
+            }
+            save(s, child, depth, indent);
+        }
+
+    }else if(node.type == QDomNode::ElementNode){
+        const bool newlines = indent != -1;
+        const bool indented = indent >= 1;
+        if(indented && (node.previousSibling < 0 || !nodes.at(node.previousSibling).text)){
+            s << QString(depth*indent, QLatin1Char(' '));
+        }
+        s << view(node.markup);
+
+        if(node.firstChild < 0){
+            s << QStringLiteral("/>");
+        }else{
+            s << QLatin1Char('>');
+            if(newlines && !nodes.at(node.firstChild).text){
+                s << Qt::endl;
+            }
+            int gap = indent == -1 ? node.gaps : -1;
+            for(int child = node.firstChild; child >= 0; child = nodes.at(child).nextSibling){
+                if(gap >= 0){
+                    s << view(gapSpans.at(gap++));
+                }
+                save(s, child, depth + 1, indent);
+            }
+            if(gap >= 0){
+                s << view(gapSpans.at(gap));
+            }
+            if(indented && !nodes.at(node.lastChild).text){
+                s << QString(depth*indent, QLatin1Char(' '));
+            }
+            s << QStringLiteral("</") << view(node.name) << QLatin1Char('>');
+        }
+
+        if(newlines && (node.nextSibling < 0 || !nodes.at(node.nextSibling).text)){
+            s << Qt::endl;
+        }
+
+    }else{
+        if(indent >= 1 && node.indented){
+            s << QString(indent, QLatin1Char(' '));
+        }
+        if(node.markup.length >= 0){
+            s << view(node.markup);
+        }else if(node.type == QDomNode::CDATASectionNode){
+            s << QStringLiteral("<![CDATA[") << view(node.value) << QStringLiteral("]]>");
+        }else{
+            s << view(node.value);
+        }
+    }
+}
+
+//Same steps as QDomCompatPathPlan::evaluate(), the index order being the document order.
+QVector<int> QDomCompatFrozenData::evaluate(const QDomCompatPathPlan &plan, int context) const
+{
+    QVector<int> list;
+    if(context < 0 || context >= nodes.size() || !plan.errorString.isEmpty()){
+        return list;
+    }
+    list.append(plan.absolute ? 0 : context);
+
+    for(const QDomCompatPathStep &step: plan.steps){
+        if(list.isEmpty()){
+            break;
+        }
+        QVector<int> next;
+        for(int index: list){
+            select(index, step, &next);
+        }
+        std::sort(next.begin(), next.end());
+        next.erase(std::unique(next.begin(), next.end()), next.end());
+        list = next;
+    }
+    return list;
+}
+
+void QDomCompatFrozenData::select(int index, const QDomCompatPathStep &step, QVector<int> *out) const
+{
+    const Node &node = nodes.at(index);
+    switch(step.axis){
+    case QDomCompatPathStep::Child:
+        *out += children(index, step);
+        break;
+    case QDomCompatPathStep::Descendant:
+        for(int i=index; i<node.end; i++){
+            if(nodes.at(i).firstChild >= 0){
+                *out += children(i, step);
+            }
+        }
+        break;
+    case QDomCompatPathStep::Self:
+        out->append(index);
+        break;
+    case QDomCompatPathStep::Parent:
+        if(node.parent >= 0){
+            out->append(node.parent);
+        }
+        break;
+    case QDomCompatPathStep::Attribute:
+        if(node.type == QDomNode::ElementNode){
+            if(step.name.localName == QLatin1String("*")){
+                for(int i=node.firstAttribute; i<node.firstAttribute + node.attributeCount; i++){
+                    if(matches(i, step.name)){
+                        out->append(i);
+                    }
+                }
+            }else{
+                const int attr = attribute(index, step.name);
+                if(attr >= 0){
+                    out->append(attr);
+                }
+            }
+        }
+        break;
+    }
+}
+
+QVector<int> QDomCompatFrozenData::children(int parent, const QDomCompatPathStep &step) const
+{
+    QVector<int> list;
+    for(int child = nodes.at(parent).firstChild; child >= 0; child = nodes.at(child).nextSibling){
+        if(matches(child, step)){
+            list.append(child);
+        }
+    }
+    //each predicate sees the positions left by the previous one
+    for(const QDomCompatPathPredicate &predicate: step.predicates){
+        if(list.isEmpty()){
+            break;
+        }
+        list = filter(list, predicate);
+    }
+    return list;
+}
+
+QVector<int> QDomCompatFrozenData::filter(const QVector<int> &list, const QDomCompatPathPredicate &predicate) const
+{
+    QVector<int> result;
+    if(predicate.kind == QDomCompatPathPredicate::Position){
+        if(predicate.position >= 1 && predicate.position <= list.size()){
+            result.append(list.at(predicate.position - 1));
+        }
+    }else if(predicate.kind == QDomCompatPathPredicate::Last){
+        result.append(list.last());
+    }else{
+        for(int index: list){
+            if(accepts(index, predicate)){
+                result.append(index);
+            }
+        }
+    }
+    return result;
+}
+
+bool QDomCompatFrozenData::accepts(int index, const QDomCompatPathPredicate &predicate) const
+{
+    if(predicate.kind == QDomCompatPathPredicate::Attribute){
+        const int attr = attribute(index, predicate.name);
+        if(attr < 0){
+            return false;
+        }
+        return !predicate.compare || ((view(nodes.at(attr).value) == predicate.value) == predicate.equal);
+    }
+
+    for(int child = nodes.at(index).firstChild; child >= 0; child = nodes.at(child).nextSibling){
+        if(nodes.at(child).type == QDomNode::ElementNode && matches(child, predicate.name)){
+            if(!predicate.compare || ((text(child) == predicate.value) == predicate.equal)){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool QDomCompatFrozenData::matches(int index, const QDomCompatPathStep &step) const
+{
+    switch(step.test){
+    case QDomCompatPathStep::Name:
+        return nodes.at(index).type == QDomNode::ElementNode && matches(index, step.name);
+    case QDomCompatPathStep::Text:
+        return nodes.at(index).text;
+    case QDomCompatPathStep::AnyNode:
+        return true;
+    }
+    return false;
+}
+
+//QDomCompatPathName::matches() on the spans.
+bool QDomCompatFrozenData::matches(int index, const QDomCompatPathName &name) const
+{
+    if(name.prefix.isEmpty() && name.localName == QLatin1String("*")){
+        return true;
+    }
+    const Node &node = nodes.at(index);
+    if(node.localName.length < 0){
+        //created without namespace processing, compare the name as written
+        if(name.localName == QLatin1String("*")){
+            const QString prefix = name.prefix + QLatin1Char(':');
+            return view(node.name).startsWith(prefix);
+        }
+        return view(node.name) == name.qualifiedName;
+    }
+    if(name.bound || name.prefix.isEmpty()){
+        if(view(node.namespaceURI) != name.namespaceURI){
+            return false;
+        }
+    }else if(view(node.prefix) != name.prefix){
+        //unbound prefixes are compared as written
+        return false;
+    }
+    return name.localName == QLatin1String("*") || view(node.localName) == name.localName;
+}
+
+int QDomCompatFrozenData::attribute(int element, const QDomCompatPathName &name) const
+{
+    if(nodes.at(element).type != QDomNode::ElementNode){
+        return -1;
+    }
+    if(name.bound){
+        const int attr = attributeNS(element, name.namespaceURI, name.localName);
+        if(attr >= 0){
+            return attr;
+        }
+    }
+    const int attr = attribute(element, QStringView(name.qualifiedName));
+    if(attr >= 0 && matches(attr, name)){
+        return attr;
+    }
+    return -1;
+}
+
+QDomCompatFrozenBuilder::QDomCompatFrozenBuilder(const QDomDocumentCompat &document)
+    : document(document)
+    , data(nullptr)
+{
+}
+
+QDomCompatFrozenDocument QDomCompatFrozenBuilder::build()
+{
+    QDomCompatFrozenDocument frozen;
+    if(document.isNull()){
+        return frozen;
+    }
+    data = new QDomCompatFrozenData();
+    frozen.d = QSharedPointer<const QDomCompatFrozenData>(data);
+
+    add(document, -1);
+    const QDomDocumentType doctype = document.doctype();
+    if(!doctype.isNull()){
+        data->doctype = append(render(doctype, -1));
+    }
+
+    data->chars.squeeze();
+    data->nodes.squeeze();
+    data->gapSpans.squeeze();
+    data = nullptr;
+    interned.clear();
+    return frozen;
+}
+
+int QDomCompatFrozenBuilder::add(const QDomNode &node, int parent)
+{
+    const int index = data->nodes.size();
+    QDomCompatFrozenData::Node frozen;
+    frozen.type = node.nodeType();
+    frozen.text = node.isText();
+    frozen.parent = parent;
+    frozen.name = intern(node.nodeName());
+    frozen.localName = intern(node.localName());
+    frozen.prefix = intern(node.prefix());
+    frozen.namespaceURI = intern(node.namespaceURI());
+    const QString value = node.isText() ? document.textValue(node) : node.nodeValue();
+    frozen.value = append(value);
+    if(node.isElement()){
+        frozen.markup = append(document.startTag(node));
+    }else if(!node.isDocument() && !node.isAttr()){
+        //leaves for save(), an entity reference writes its name only. Most text needs no
+        //escaping and most CDATA only its delimiters, those are written from the value.
+        const QString markup = render(node, -1);
+        if(markup != value && !(node.isCDATASection() && isCDATAMarkup(markup, value))){
+            frozen.markup = append(markup);
+        }
+        //QDomNode::save() writes comments at depth 1, unless that would split text
+        frozen.indented = node.isComment() && !node.previousSibling().isText();
+    }
+    data->nodes.append(frozen);
+
+    if(node.isElement()){
+        addIndex(index, node);
+
+        const QDomNamedNodeMap attrs = node.attributes();
+        const int attr_count = attrs.count();
+        data->nodes[index].firstAttribute = data->nodes.size();
+        data->nodes[index].attributeCount = attr_count;
+        for(int i=0; i<attr_count; i++){
+            add(attrs.item(i), index);
+        }
+
+        if(!document.whitespaceStore.isNull()){
+            const QVector<QString> *gaps = document.whitespaceStore->gaps(node);
+            if(gaps != nullptr){
+                data->nodes[index].gaps = data->gapSpans.size();
+                for(const QString &gap: *gaps){
+                    data->gapSpans.append(intern(gap));
+                }
+            }
+        }
+    }
+
+    //an attribute keeps its value in a text child
+    if(!node.isAttr()){
+        int previous = -1;
+        for(QDomNode child = node.firstChild(); !child.isNull(); child = child.nextSibling()){
+            const int next = add(child, index);
+            data->nodes[next].previousSibling = previous;
+            if(previous < 0){
+                data->nodes[index].firstChild = next;
+            }else{
+                data->nodes[previous].nextSibling = next;
+            }
+            previous = next;
+        }
+        data->nodes[index].lastChild = previous;
+    }
+    data->nodes[index].end = data->nodes.size();
+    return index;
+}
+
+//Same keys as QDomCompatElementIndex.
+void QDomCompatFrozenBuilder::addIndex(int index, const QDomNode &element)
+{
+    QString namespaceURI;
+    QString localName;
+    QDomCompatDigester::canonicalName(element, &namespaceURI, &localName);
+    data->names[indexKey(namespaceURI, localName)].append(index);
+
+    if(element.hasAttributes()){
+        for(const QString &name: document.idAttributeNames){
+            const QDomAttr attr = element.toElement().attributeNode(name);
+            if(!attr.isNull() && !data->ids.contains(attr.value())){
+                data->ids.insert(attr.value(), index);
+            }
+        }
+    }
+}
+
+QDomCompatFrozenData::Span QDomCompatFrozenBuilder::append(const QString &text)
+{
+    QDomCompatFrozenData::Span span;
+    if(!text.isNull()){
+        span.offset = data->chars.size();
+        span.length = text.size();
+        data->chars += text;
+    }
+    return span;
+}
+
+//Names and whitespace repeat throughout a document, they are stored once.
+QDomCompatFrozenData::Span QDomCompatFrozenBuilder::intern(const QString &text)
+{
+    if(text.isNull()){
+        return QDomCompatFrozenData::Span();
+    }
+    QHash<QString, QDomCompatFrozenData::Span>::const_iterator it = interned.constFind(text);
+    if(it != interned.constEnd()){
+        return *it;
+    }
+    const QDomCompatFrozenData::Span span = append(text);
+    interned.insert(text, span);
+    return span;
+}
+
+QString QDomCompatFrozenBuilder::render(const QDomNode &node, int indent) const
+{
+    QString str;
+    QTextStream s(&str, QIODevice::WriteOnly);
+    document.save(s, node, 0, indent);
+    return str;
+}
+
+QDomCompatFrozenNode::QDomCompatFrozenNode()
+    : d(nullptr)
+    , i(-1)
+{
+}
+
+QDomCompatFrozenNode::QDomCompatFrozenNode(const QDomCompatFrozenData *data, int index)
+    : d(index < 0 ? nullptr : data)
+    , i(index < 0 ? -1 : index)
+{
+}
+
+bool QDomCompatFrozenNode::isNull() const
+{
+    return d == nullptr;
+}
+
+QDomNode::NodeType QDomCompatFrozenNode::nodeType() const
+{
+    return d == nullptr ? QDomNode::BaseNode : d->nodes.at(i).type;
+}
+
+bool QDomCompatFrozenNode::isDocument() const
+{
+    return nodeType() == QDomNode::DocumentNode;
+}
+
+bool QDomCompatFrozenNode::isElement() const
+{
+    return nodeType() == QDomNode::ElementNode;
+}
+
+bool QDomCompatFrozenNode::isAttr() const
+{
+    return nodeType() == QDomNode::AttributeNode;
+}
+
+bool QDomCompatFrozenNode::isText() const
+{
+    return d != nullptr && d->nodes.at(i).text;
+}
+
+QStringView QDomCompatFrozenNode::nodeName() const
+{
+    return d == nullptr ? QStringView() : d->view(d->nodes.at(i).name);
+}
+
+QStringView QDomCompatFrozenNode::localName() const
+{
+    return d == nullptr ? QStringView() : d->view(d->nodes.at(i).localName);
+}
+
+QStringView QDomCompatFrozenNode::prefix() const
+{
+    return d == nullptr ? QStringView() : d->view(d->nodes.at(i).prefix);
+}
+
+QStringView QDomCompatFrozenNode::namespaceURI() const
+{
+    return d == nullptr ? QStringView() : d->view(d->nodes.at(i).namespaceURI);
+}
+
+QStringView QDomCompatFrozenNode::nodeValue() const
+{
+    return d == nullptr ? QStringView() : d->view(d->nodes.at(i).value);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::parentNode() const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->nodes.at(i).parent);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::firstChild() const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->nodes.at(i).firstChild);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::lastChild() const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->nodes.at(i).lastChild);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::nextSibling() const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->nodes.at(i).nextSibling);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::previousSibling() const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->nodes.at(i).previousSibling);
+}
+
+bool QDomCompatFrozenNode::hasChildNodes() const
+{
+    return d != nullptr && d->nodes.at(i).firstChild >= 0;
+}
+
+int QDomCompatFrozenNode::attributeCount() const
+{
+    return d == nullptr ? 0 : d->nodes.at(i).attributeCount;
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::attributeAt(int index) const
+{
+    if(index < 0 || index >= attributeCount()){
+        return QDomCompatFrozenNode();
+    }
+    return QDomCompatFrozenNode(d, d->nodes.at(i).firstAttribute + index);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::attributeNode(QStringView qualifiedName) const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->attribute(i, qualifiedName));
+}
+
+QDomCompatFrozenNode QDomCompatFrozenNode::attributeNodeNS(QStringView namespaceURI, QStringView localName) const
+{
+    return d == nullptr ? QDomCompatFrozenNode() : QDomCompatFrozenNode(d, d->attributeNS(i, namespaceURI, localName));
+}
+
+QStringView QDomCompatFrozenNode::attribute(QStringView qualifiedName) const
+{
+    return attributeNode(qualifiedName).nodeValue();
+}
+
+QString QDomCompatFrozenNode::text() const
+{
+    return d == nullptr ? QString() : d->text(i);
+}
+
+int QDomCompatFrozenNode::index() const
+{
+    return i;
+}
+
+bool QDomCompatFrozenNode::operator==(const QDomCompatFrozenNode &other) const
+{
+    return d == other.d && i == other.i;
+}
+
+bool QDomCompatFrozenNode::operator!=(const QDomCompatFrozenNode &other) const
+{
+    return !(*this == other);
+}
+
+QDomCompatFrozenDocument::QDomCompatFrozenDocument()
+{
+}
+
+bool QDomCompatFrozenDocument::isNull() const
+{
+    return d.isNull();
+}
+
+int QDomCompatFrozenDocument::nodeCount() const
+{
+    return d.isNull() ? 0 : d->nodes.size();
+}
+
+QDomCompatFrozenNode QDomCompatFrozenDocument::node(int index) const
+{
+    if(index < 0 || index >= nodeCount()){
+        return QDomCompatFrozenNode();
+    }
+    return QDomCompatFrozenNode(d.data(), index);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenDocument::documentNode() const
+{
+    return node(0);
+}
+
+QDomCompatFrozenNode QDomCompatFrozenDocument::documentElement() const
+{
+    for(QDomCompatFrozenNode child = documentNode().firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(child.isElement()){
+            return child;
+        }
+    }
+    return QDomCompatFrozenNode();
+}
+
+QVector<QDomCompatFrozenNode> QDomCompatFrozenDocument::elementsByName(const QString &namespaceURI, const QString &localName) const
+{
+    QVector<QDomCompatFrozenNode> result;
+    if(d.isNull()){
+        return result;
+    }
+    //read in place, a copy of the vector would write its shared reference count
+    const QHash<QString, QVector<int>>::const_iterator it = d->names.constFind(indexKey(namespaceURI, localName));
+    if(it == d->names.constEnd()){
+        return result;
+    }
+    result.reserve(it->size());
+    for(int index: *it){
+        result.append(QDomCompatFrozenNode(d.data(), index));
+    }
+    return result;
+}
+
+QDomCompatFrozenNode QDomCompatFrozenDocument::elementById(const QString &elementId) const
+{
+    if(d.isNull()){
+        return QDomCompatFrozenNode();
+    }
+    return QDomCompatFrozenNode(d.data(), d->ids.value(elementId, -1));
+}
+
+QVector<QDomCompatFrozenNode> QDomCompatFrozenDocument::select(const QString &expression, const QHash<QString, QString> &namespaces) const
+{
+    return QDomCompatPath(expression, namespaces).evaluate(documentNode());
+}
+
+void QDomCompatFrozenDocument::save(QTextStream &s, int indent) const
+{
+    if(!d.isNull()){
+        d->save(s, 0, 0, indent);
+    }
+}
+
+QString QDomCompatFrozenDocument::toString(int indent) const
+{
+    QString str;
+    QTextStream s(&str, QIODevice::WriteOnly);
+    save(s, indent);
+    return str;
+}
@@ -0,0 +1,104 @@
+#ifndef QDOMCOMPATFROZEN_H
+#define QDOMCOMPATFROZEN_H
+
+#include "qtxmlcompat_global.h"
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QStringView>
+#include <QTextStream>
+#include <QVector>
+#include <QtXml/QDomNode>
+
+class QDomCompatFrozenData;
+class QDomCompatFrozenBuilder;
+class QDomCompatPath;
+
+// Node of a QDomCompatFrozenDocument, an index into the document's arrays.
+// Copying or walking it touches no reference count. Valid as long as the document is.
+class QTXMLCOMPAT_EXPORT QDomCompatFrozenNode
+{
+public:
+    QDomCompatFrozenNode();
+
+    bool isNull() const;
+    QDomNode::NodeType nodeType() const;
+    bool isDocument() const;
+    bool isElement() const;
+    bool isAttr() const;
+    bool isText() const;    // text and CDATA, like QDomNode::isText()
+
+    // Null views where the QDomNode strings are null.
+    QStringView nodeName() const;
+    QStringView localName() const;
+    QStringView prefix() const;
+    QStringView namespaceURI() const;
+    QStringView nodeValue() const;
+
+    // The owner element for attributes.
+    QDomCompatFrozenNode parentNode() const;
+    QDomCompatFrozenNode firstChild() const;
+    QDomCompatFrozenNode lastChild() const;
+    QDomCompatFrozenNode nextSibling() const;
+    QDomCompatFrozenNode previousSibling() const;
+    bool hasChildNodes() const;
+
+    int attributeCount() const;
+    QDomCompatFrozenNode attributeAt(int i) const;
+    QDomCompatFrozenNode attributeNode(QStringView qualifiedName) const;
+    QDomCompatFrozenNode attributeNodeNS(QStringView namespaceURI, QStringView localName) const;
+    QStringView attribute(QStringView qualifiedName) const;
+
+    // Text and CDATA below the node, like QDomElement::text().
+    QString text() const;
+
+    // Position in document order, attributes right after their element.
+    int index() const;
+
+    bool operator==(const QDomCompatFrozenNode &other) const;
+    bool operator!=(const QDomCompatFrozenNode &other) const;
+
+private:
+    friend class QDomCompatFrozenDocument;
+    friend class QDomCompatPath;
+
+    QDomCompatFrozenNode(const QDomCompatFrozenData *data, int index);
+
+    const QDomCompatFrozenData *d;
+    int i;
+};
+
+// Read-only snapshot made by QDomDocumentCompat::freeze(). Nodes live in one array in
+// document order and their strings in one buffer. Reading it modifies nothing, not even
+// reference counts, so any number of threads can share it without locking.
+// save() and toString() write what the document's toString() wrote at the time of the freeze.
+class QTXMLCOMPAT_EXPORT QDomCompatFrozenDocument
+{
+public:
+    QDomCompatFrozenDocument();
+
+    bool isNull() const;
+    int nodeCount() const;
+    QDomCompatFrozenNode node(int index) const;
+    QDomCompatFrozenNode documentNode() const;
+    QDomCompatFrozenNode documentElement() const;
+
+    // Same keys as QDomDocumentCompat::elementsByName() and elementById(), built by freeze().
+    QVector<QDomCompatFrozenNode> elementsByName(const QString &namespaceURI, const QString &localName) const;
+    QDomCompatFrozenNode elementById(const QString &elementId) const;
+
+    // Evaluates a QDomCompatPath from the document node. The expression is looked up in
+    // QDomCompatPath's shared plan cache, which takes a mutex; threads running the same
+    // query in a loop should construct the QDomCompatPath once and call evaluate().
+    QVector<QDomCompatFrozenNode> select(const QString &expression, const QHash<QString, QString> &namespaces = QHash<QString, QString>()) const;
+
+    void save(QTextStream &s, int indent) const;
+    QString toString(int indent = 1) const;
+
+private:
+    friend class QDomCompatFrozenBuilder;
+
+    QSharedPointer<const QDomCompatFrozenData> d;
+};
+
+#endif // QDOMCOMPATFROZEN_H
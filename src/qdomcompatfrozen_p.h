@@ -0,0 +1,93 @@
+#ifndef QDOMCOMPATFROZEN_P_H
+#define QDOMCOMPATFROZEN_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+#include "qdomcompatpath_p.h"
+
+// Nodes in pre-order, each element followed by its attributes and then its
+// children, so the index order is the document order. Strings are spans of
+// one buffer. save() writes the children from the array; only start tags, and
+// the markup of leaves that isn't their plain value, are rendered by the freeze.
+class QDomCompatFrozenData
+{
+public:
+    struct Span {
+        int offset;
+        int length;     // -1 for a null string
+
+        Span() : offset(0), length(-1) {}
+    };
+
+    struct Node {
+        QDomNode::NodeType type;
+        bool text;              // QDomNode::isText(), CDATA included
+        bool indented;          // a comment, save() with indent > 0 writes `indent` spaces before it
+        int parent;
+        int firstChild;
+        int lastChild;
+        int nextSibling;
+        int previousSibling;
+        int end;                // one past the last node of the subtree
+        int firstAttribute;
+        int attributeCount;
+        int gaps;               // first of the element's gapSpans, -1 for none
+        Span name;
+        Span localName;
+        Span prefix;
+        Span namespaceURI;
+        Span value;
+        Span markup;            // start tag through the attributes, or a leaf as save(-1) writes it;
+                                // null when that is the value, or the value in CDATA delimiters
+
+        Node();
+    };
+
+    QString chars;
+    QVector<Node> nodes;
+    QVector<Span> gapSpans;     // whitespace dropped by the parse, children + 1 per element
+    Span doctype;
+    QHash<QString, QVector<int>> names;
+    QHash<QString, int> ids;
+
+    QStringView view(const Span &span) const;
+    QString text(int index) const;
+    int attribute(int element, QStringView qualifiedName) const;
+    int attributeNS(int element, QStringView namespaceURI, QStringView localName) const;
+
+    void save(QTextStream &s, int index, int depth, int indent) const;
+
+    QVector<int> evaluate(const QDomCompatPathPlan &plan, int context) const;
+
+private:
+    void select(int index, const QDomCompatPathStep &step, QVector<int> *out) const;
+    QVector<int> children(int parent, const QDomCompatPathStep &step) const;
+    QVector<int> filter(const QVector<int> &list, const QDomCompatPathPredicate &predicate) const;
+    bool accepts(int index, const QDomCompatPathPredicate &predicate) const;
+    bool matches(int index, const QDomCompatPathStep &step) const;
+    bool matches(int index, const QDomCompatPathName &name) const;
+    int attribute(int element, const QDomCompatPathName &name) const;
+};
+
+// Copies a QDomDocumentCompat into a QDomCompatFrozenData.
+class QDomCompatFrozenBuilder
+{
+public:
+    explicit QDomCompatFrozenBuilder(const QDomDocumentCompat &document);
+
+    QDomCompatFrozenDocument build();
+
+private:
+    const QDomDocumentCompat &document;
+    QDomCompatFrozenData *data;
+    QHash<QString, QDomCompatFrozenData::Span> interned;
+
+    int add(const QDomNode &node, int parent);
+    void addIndex(int index, const QDomNode &element);
+    QDomCompatFrozenData::Span append(const QString &text);
+    QDomCompatFrozenData::Span intern(const QString &text);
+    QString render(const QDomNode &node, int indent) const;
+};
+
+#endif // QDOMCOMPATFROZEN_P_H
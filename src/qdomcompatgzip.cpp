@@ -0,0 +1,279 @@
+#include "qdomcompatgzip_p.h"
+
+#ifdef QTXMLCOMPAT_ZLIB
+#include <zlib.h>
+
+static QString zlibError(const z_stream *stream, const char *fallback)
+{
+    return QStringLiteral("Compressed data: ") + QString::fromLatin1(stream->msg != nullptr ? stream->msg : fallback);
+}
+#endif
+
+QDomCompatGzipDevice::QDomCompatGzipDevice(QIODevice *device)
+    : QIODevice()
+    , device(device)
+    , stream(nullptr)
+    , finished(false)
+    , failed(false)
+{
+    Q_ASSERT(device);
+}
+
+QDomCompatGzipDevice::~QDomCompatGzipDevice()
+{
+    close();
+}
+
+bool QDomCompatGzipDevice::isSupported()
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool QDomCompatGzipDevice::isCompressed(const char *data, qint64 size)
+{
+    if(size < 2){
+        return false;
+    }
+    const uint first = uchar(data[0]);
+    const uint second = uchar(data[1]);
+    if(first == 0x1f && second == 0x8b){
+        return true;
+    }
+    //deflate with a window of at most 32K and valid check bits, no XML start looks like that
+    return (first & 0x0f) == 8 && (first >> 4) <= 7 && ((first << 8) | second) % 31 == 0;
+}
+
+QIODevice *QDomCompatGzipDevice::openForInput()
+{
+    //QXmlInputSource opens it the same way, and reports the failure as an empty document
+    if(!device->isOpen() && !device->open(QIODevice::ReadOnly)){
+        return device;
+    }
+    const QByteArray header = device->peek(2);
+    if(!isCompressed(header.constData(), header.size())){
+        return device;
+    }
+    return open(QIODevice::ReadOnly) ? this : nullptr;
+}
+
+bool QDomCompatGzipDevice::open(OpenMode mode)
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    const OpenMode direction = mode & ReadWrite;
+    if(isOpen() || direction == ReadWrite || direction == NotOpen){
+        fail(QStringLiteral("Compressed data is either read or written"));
+        return false;
+    }
+
+    z_stream *z = new z_stream;
+    z->zalloc = Z_NULL;
+    z->zfree = Z_NULL;
+    z->opaque = Z_NULL;
+    z->next_in = Z_NULL;
+    z->avail_in = 0;
+    //+32 accepts gzip and zlib headers, +16 writes a gzip header and trailer
+    const int ret = direction == ReadOnly
+            ? inflateInit2(z, 15 + 32)
+            : deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    if(ret != Z_OK){
+        fail(zlibError(z, "out of memory"));
+        delete z;
+        return false;
+    }
+
+    stream = z;
+    buffer.resize(ChunkSize);
+    finished = false;
+    failed = false;
+    //the chunks are buffered here, QIODevice's buffer would only add a copy
+    return QIODevice::open(mode | Unbuffered);
+#else
+    Q_UNUSED(mode)
+    fail(QStringLiteral("Compressed data needs zlib, the library was built without it"));
+    return false;
+#endif
+}
+
+bool QDomCompatGzipDevice::finish()
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    if(stream == nullptr || !isWritable() || finished || failed){
+        return !failed;
+    }
+    finished = true;
+    stream->next_in = Z_NULL;
+    stream->avail_in = 0;
+    return deflateChunks(Z_FINISH);
+#else
+    return !failed;
+#endif
+}
+
+bool QDomCompatGzipDevice::hasError() const
+{
+    return failed;
+}
+
+bool QDomCompatGzipDevice::isSequential() const
+{
+    return true;
+}
+
+bool QDomCompatGzipDevice::atEnd() const
+{
+    return !isReadable() || finished;
+}
+
+void QDomCompatGzipDevice::close()
+{
+    if(!isOpen()){
+        return;
+    }
+#ifdef QTXMLCOMPAT_ZLIB
+    if(isWritable()){
+        finish();
+        deflateEnd(stream);
+    }else{
+        inflateEnd(stream);
+    }
+    delete stream;
+    stream = nullptr;
+#endif
+    buffer.clear();
+    QIODevice::close();
+}
+
+qint64 QDomCompatGzipDevice::readData(char *data, qint64 maxSize)
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    if(failed){
+        return -1;
+    }
+    if(finished || maxSize <= 0){
+        return 0;
+    }
+
+    const qint64 wanted = qMin<qint64>(maxSize, ChunkSize);
+    stream->next_out = reinterpret_cast<Bytef *>(data);
+    stream->avail_out = uInt(wanted);
+    while(stream->avail_out > 0){
+        if(stream->avail_in == 0){
+            qint64 size = device->read(buffer.data(), ChunkSize);
+            //a file or buffer is at its end, a socket or pipe gets a bounded wait for more
+            if(size == 0 && device->isSequential() && device->waitForReadyRead(ReadTimeout)){
+                size = device->read(buffer.data(), ChunkSize);
+            }
+            if(size < 0){
+                fail(device->errorString());
+                return -1;
+            }
+            if(size == 0){
+                break;
+            }
+            stream->next_in = reinterpret_cast<Bytef *>(buffer.data());
+            stream->avail_in = uInt(size);
+        }
+
+        const int ret = inflate(stream, Z_NO_FLUSH);
+        if(ret == Z_STREAM_END){
+            //a gzip file can hold several members, read them as one stream like gzip does;
+            //anything else after the end, padding or garbage, is ignored like gzip does
+            if(!nextIsMember()){
+                finished = true;
+                break;
+            }
+            inflateReset(stream);
+        }else if(ret != Z_OK && ret != Z_BUF_ERROR){
+            //what was inflated before is still returned, the next read fails
+            fail(zlibError(stream, "invalid data"));
+            break;
+        }
+    }
+
+    const qint64 size = wanted - stream->avail_out;
+    if(size == 0 && !finished){
+        if(!failed){
+            fail(QStringLiteral("Compressed data: unexpected end of input"));
+        }
+        return -1;
+    }
+    return size;
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+#endif
+}
+
+qint64 QDomCompatGzipDevice::writeData(const char *data, qint64 maxSize)
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    //QTextStream hands over its buffer, one chunk is usually enough
+    qint64 written = 0;
+    while(written < maxSize){
+        const qint64 size = qMin<qint64>(maxSize - written, ChunkSize);
+        stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data + written));
+        stream->avail_in = uInt(size);
+        if(!deflateChunks(Z_NO_FLUSH)){
+            return -1;
+        }
+        written += size;
+    }
+    return maxSize;
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+#endif
+}
+
+//Whether the input left after a stream end starts with another gzip header.
+bool QDomCompatGzipDevice::nextIsMember() const
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    QByteArray header = QByteArray::fromRawData(reinterpret_cast<const char *>(stream->next_in), int(qMin<uInt>(stream->avail_in, 2)));
+    if(header.size() < 2){
+        header += device->peek(2 - header.size());
+    }
+    return header.size() == 2 && uchar(header.at(0)) == 0x1f && uchar(header.at(1)) == 0x8b;
+#else
+    return false;
+#endif
+}
+
+void QDomCompatGzipDevice::fail(const QString &message)
+{
+    failed = true;
+    setErrorString(message);
+}
+
+//Deflates the pending input and writes the output a chunk at a time, up to
+//the trailer for Z_FINISH.
+bool QDomCompatGzipDevice::deflateChunks(int flush)
+{
+#ifdef QTXMLCOMPAT_ZLIB
+    int ret;
+    do{
+        stream->next_out = reinterpret_cast<Bytef *>(buffer.data());
+        stream->avail_out = ChunkSize;
+        ret = deflate(stream, flush);
+        if(ret == Z_STREAM_ERROR){
+            fail(zlibError(stream, "stream error"));
+            return false;
+        }
+        const qint64 size = ChunkSize - stream->avail_out;
+        if(size > 0 && device->write(buffer.constData(), size) != size){
+            fail(device->errorString());
+            return false;
+        }
+    }while(flush == Z_FINISH ? ret != Z_STREAM_END : stream->avail_out == 0);
+    return true;
+#else
+    Q_UNUSED(flush)
+    return false;
+#endif
+}
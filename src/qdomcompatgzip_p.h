@@ -0,0 +1,60 @@
+#ifndef QDOMCOMPATGZIP_P_H
+#define QDOMCOMPATGZIP_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include <QByteArray>
+#include <QIODevice>
+
+struct z_stream_s;
+
+// Sequential device over another one that inflates gzip or zlib data when
+// opened for reading, and deflates to gzip when opened for writing. Both ways
+// go through one chunk buffer, so memory doesn't grow with the data.
+// Concatenated gzip members are read as one stream, other bytes after the end
+// are ignored. A sequential device is waited on for ReadTimeout ms at most.
+// Without zlib in the build open() fails.
+class QDomCompatGzipDevice : public QIODevice
+{
+public:
+    explicit QDomCompatGzipDevice(QIODevice *device);
+    ~QDomCompatGzipDevice();
+
+    static bool isSupported();
+    // Whether the bytes start with a gzip header or a zlib header of a deflate stream.
+    static bool isCompressed(const char *data, qint64 size);
+
+    // Opens the device for reading when the wrapped one starts with a compressed header.
+    // Returns the device to parse: the wrapped one for uncompressed data, this one,
+    // or null when the header was found but the data can't be read (see errorString()).
+    QIODevice *openForInput();
+
+    // Writes the rest of the compressed data and the gzip trailer. Called by close().
+    bool finish();
+    // Whether reading or writing failed, errorString() says why.
+    bool hasError() const;
+
+    bool open(OpenMode mode) override;
+    bool isSequential() const override;
+    bool atEnd() const override;
+    void close() override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    enum { ChunkSize = 64 * 1024, ReadTimeout = 30000 };
+
+    QIODevice *device;
+    z_stream_s *stream;     // null until opened
+    QByteArray buffer;      // compressed input not inflated yet, or output not written yet
+    bool finished;          // end of the compressed data, or trailer written
+    bool failed;
+
+    void fail(const QString &message);
+    bool nextIsMember() const;
+    bool deflateChunks(int flush);
+};
+
+#endif // QDOMCOMPATGZIP_P_H
@@ -0,0 +1,111 @@
+#include "qdomcompatindex_p.h"
+#include "qdomcompatdigest_p.h"
+#include "qdomcompattext_p.h"
+
+#include <QMutexLocker>
+
+QDomCompatElementIndex::QDomCompatElementIndex(const QStringList &idAttributes)
+    : idAttributes(idAttributes)
+    , valid(true)
+    , documentElement(nullptr)
+{
+}
+
+void QDomCompatElementIndex::add(const QString &namespaceURI, const QString &localName, const QDomElement &element, const QXmlAttributes &atts)
+{
+    //the parse reports the document element first
+    if(names.isEmpty()){
+        documentElement = QDomCompatNodeAccess::identity(element);
+    }
+    names[key(namespaceURI, localName)].append(element);
+
+    for(int i=0; i<atts.length(); i++){
+        if(idAttributes.contains(atts.qName(i))){
+            addId(atts.value(i), element);
+        }
+    }
+}
+
+void QDomCompatElementIndex::add(const QDomElement &element)
+{
+    QString namespaceURI;
+    QString localName;
+    QDomCompatDigester::canonicalName(element, &namespaceURI, &localName);
+    names[key(namespaceURI, localName)].append(element);
+
+    if(element.hasAttributes()){
+        for(const QString &name: idAttributes){
+            const QDomAttr attr = element.attributeNode(name);
+            if(!attr.isNull()){
+                addId(attr.value(), element);
+            }
+        }
+    }
+}
+
+void QDomCompatElementIndex::rebuild(const QDomNode &root)
+{
+    names.clear();
+    ids.clear();
+    documentElement = QDomCompatNodeAccess::identity(root.toDocument().documentElement());
+
+    //pre-order walk without recursion, only elements are descended into
+    QDomNode node = root.firstChild();
+    while(!node.isNull()){
+        if(node.isElement()){
+            add(node.toElement());
+            if(node.hasChildNodes()){
+                node = node.firstChild();
+                continue;
+            }
+        }
+        while(node != root && node.nextSibling().isNull()){
+            node = node.parentNode();
+        }
+        if(node == root){
+            break;
+        }
+        node = node.nextSibling();
+    }
+
+    valid = true;
+}
+
+void QDomCompatElementIndex::ensureValid(const QDomNode &root)
+{
+    QMutexLocker locker(&mutex);
+    //QDomDocument::setContent() and clear() replace the tree without invalidate(), the
+    //indexed elements keep the old document element alive, so its identity isn't reused
+    if(!valid || QDomCompatNodeAccess::identity(root.toDocument().documentElement()) != documentElement){
+        rebuild(root);
+    }
+}
+
+void QDomCompatElementIndex::invalidate()
+{
+    names.clear();
+    ids.clear();
+    valid = false;
+}
+
+QVector<QDomElement> QDomCompatElementIndex::elements(const QString &namespaceURI, const QString &localName) const
+{
+    return names.value(key(namespaceURI, localName));
+}
+
+QDomElement QDomCompatElementIndex::element(const QString &elementId) const
+{
+    return ids.value(elementId);
+}
+
+QString QDomCompatElementIndex::key(const QString &namespaceURI, const QString &localName) const
+{
+    return QLatin1Char('{') + namespaceURI + QLatin1Char('}') + localName;
+}
+
+void QDomCompatElementIndex::addId(const QString &elementId, const QDomElement &element)
+{
+    if(!ids.contains(elementId)){
+        ids.insert(elementId, element);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef QDOMCOMPATINDEX_P_H
+#define QDOMCOMPATINDEX_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+
+#include <QMutex>
+
+// Elements by namespace URI and local name, and by the value of id-like
+// attributes, in document order. Filled in by the parse handler, or by one
+// walk over the tree after invalidate() or once the document element is no
+// longer the indexed one (QDomDocument::setContent(), clear()). Copies of a
+// document share the tree and so the index; the lazy rebuild runs under a
+// mutex, so lookups from several threads are safe as long as none of them
+// edits or invalidates.
+class QDomCompatElementIndex
+{
+public:
+    explicit QDomCompatElementIndex(const QStringList &idAttributes);
+
+    void add(const QString &namespaceURI, const QString &localName, const QDomElement &element, const QXmlAttributes &atts);
+    void add(const QDomElement &element);
+    void rebuild(const QDomNode &root);
+    // Rebuilds from the root if invalidated or replaced, one thread at a time.
+    void ensureValid(const QDomNode &root);
+    void invalidate();
+
+    QVector<QDomElement> elements(const QString &namespaceURI, const QString &localName) const;
+    QDomElement element(const QString &elementId) const;
+
+private:
+    QStringList idAttributes;
+    QHash<QString, QVector<QDomElement>> names;
+    QHash<QString, QDomElement> ids;    // the first element wins
+    bool valid;
+    const void *documentElement;        // identity of the indexed one, null for none
+    QMutex mutex;                       // held by ensureValid()
+
+    QString key(const QString &namespaceURI, const QString &localName) const;
+    void addId(const QString &elementId, const QDomElement &element);
+};
+
+#endif // QDOMCOMPATINDEX_P_H
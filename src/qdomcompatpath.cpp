@@ -0,0 +1,726 @@
+#include "qdomcompatpath_p.h"
+#include "qdomcompatfrozen_p.h"
+#include "qdomcompattext_p.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QStringList>
+
+struct QDomCompatPathCacheEntry {
+    QSharedPointer<const QDomCompatPathPlan> plan;
+    quint64 used;               // tick of the last lookup
+};
+
+struct QDomCompatPathCache {
+    QMutex mutex;
+    QHash<QString, QDomCompatPathCacheEntry> plans;
+    quint64 tick;
+
+    QDomCompatPathCache() : tick(0) {}
+};
+
+Q_GLOBAL_STATIC(QDomCompatPathCache, pathCache)
+
+//A full cache drops the least recently used plan, found by a scan that costs
+//less than compiling. The plans in use stay alive through their paths.
+static const int CacheLimit = 256;
+
+static QString cacheKey(const QString &expression, const QHash<QString, QString> &namespaces)
+{
+    QStringList bindings;
+    for(QHash<QString, QString>::const_iterator it = namespaces.constBegin(); it != namespaces.constEnd(); ++it){
+        bindings.append(it.key() + QLatin1Char('=') + it.value());
+    }
+    bindings.sort();
+    return expression + QLatin1Char('\n') + bindings.join(QLatin1Char('\n'));
+}
+
+//Some of the nodes are ancestors of others, so per node results may interleave.
+static bool isNested(const QVector<QDomNode> &list)
+{
+    if(list.size() < 2){
+        return false;
+    }
+    QSet<const void *> set;
+    for(const QDomNode &node: list){
+        set.insert(QDomCompatNodeAccess::identity(node));
+    }
+    for(const QDomNode &node: list){
+        for(QDomNode parent = node.parentNode(); !parent.isNull(); parent = parent.parentNode()){
+            if(set.contains(QDomCompatNodeAccess::identity(parent))){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static QVector<QDomNode> unique(const QVector<QDomNode> &list)
+{
+    QSet<const void *> set;
+    QVector<QDomNode> result;
+    for(const QDomNode &node: list){
+        const void *id = QDomCompatNodeAccess::identity(node);
+        if(!set.contains(id)){
+            set.insert(id);
+            result.append(node);
+        }
+    }
+    return result;
+}
+
+//Sorts and deduplicates with one pre-order walk over the tree the nodes are in.
+static QVector<QDomNode> documentOrder(const QVector<QDomNode> &list)
+{
+    QSet<const void *> set;
+    for(const QDomNode &node: list){
+        set.insert(QDomCompatNodeAccess::identity(node));
+    }
+
+    QDomNode root = list.first();
+    while(!root.parentNode().isNull()){
+        root = root.parentNode();
+    }
+
+    QVector<QDomNode> result;
+    QDomNode node = root;
+    while(!node.isNull() && !set.isEmpty()){
+        if(set.remove(QDomCompatNodeAccess::identity(node))){
+            result.append(node);
+        }
+        if(node.hasChildNodes()){
+            node = node.firstChild();
+            continue;
+        }
+        while(node != root && node.nextSibling().isNull()){
+            node = node.parentNode();
+        }
+        if(node == root){
+            break;
+        }
+        node = node.nextSibling();
+    }
+    return result;
+}
+
+bool QDomCompatPathName::matches(const QDomNode &node) const
+{
+    if(prefix.isEmpty() && localName == QLatin1String("*")){
+        return true;
+    }
+    if(node.localName().isNull()){
+        //created without namespace processing, compare the name as written
+        if(localName == QLatin1String("*")){
+            return node.nodeName().startsWith(prefix + QLatin1Char(':'));
+        }
+        return node.nodeName() == qualifiedName;
+    }
+    if(bound || prefix.isEmpty()){
+        if(node.namespaceURI() != namespaceURI){
+            return false;
+        }
+    }else if(node.prefix() != prefix){
+        //unbound prefixes are compared as written
+        return false;
+    }
+    return localName == QLatin1String("*") || node.localName() == localName;
+}
+
+QVector<QDomNode> QDomCompatPathPlan::evaluate(const QDomNode &context, const QDomCompatTextStore *texts) const
+{
+    QVector<QDomNode> list;
+    if(context.isNull() || !errorString.isEmpty()){
+        return list;
+    }
+    if(absolute){
+        list.append(context.isDocument() ? context : QDomNode(context.ownerDocument()));
+    }else{
+        list.append(context);
+    }
+
+    for(const QDomCompatPathStep &step: steps){
+        if(list.isEmpty()){
+            break;
+        }
+        bool ordered = step.axis == QDomCompatPathStep::Self || !isNested(list);
+        if(step.axis == QDomCompatPathStep::Attribute && !ordered){
+            //attributes can't be found by a tree walk, order their owners instead
+            list = documentOrder(list);
+            ordered = true;
+        }
+
+        QVector<QDomNode> next;
+        for(const QDomNode &node: list){
+            select(node, step, texts, &next);
+        }
+        if(step.axis == QDomCompatPathStep::Parent){
+            next = unique(next);
+            ordered = ordered && !isNested(next);
+        }
+        if(!ordered && !next.isEmpty()){
+            next = documentOrder(next);
+        }
+        list = next;
+    }
+    return list;
+}
+
+void QDomCompatPathPlan::select(const QDomNode &node, const QDomCompatPathStep &step, const QDomCompatTextStore *texts, QVector<QDomNode> *out) const
+{
+    switch(step.axis){
+    case QDomCompatPathStep::Child:
+        *out += children(node, step, texts);
+        break;
+    case QDomCompatPathStep::Descendant:
+        descend(node, step, texts, out);
+        break;
+    case QDomCompatPathStep::Self:
+        out->append(node);
+        break;
+    case QDomCompatPathStep::Parent:
+    {
+        const QDomNode parent = node.isAttr() ? QDomNode(node.toAttr().ownerElement()) : node.parentNode();
+        if(!parent.isNull()){
+            out->append(parent);
+        }
+        break;
+    }
+    case QDomCompatPathStep::Attribute:
+        if(node.isElement()){
+            if(step.name.localName == QLatin1String("*")){
+                const QDomNamedNodeMap attrs = node.attributes();
+                const int attr_count = attrs.count();
+                for(int i=0; i<attr_count; i++){
+                    const QDomNode attr = attrs.item(i);
+                    if(step.name.matches(attr)){
+                        out->append(attr);
+                    }
+                }
+            }else{
+                const QDomNode attr = attribute(node, step.name);
+                if(!attr.isNull()){
+                    out->append(attr);
+                }
+            }
+        }
+        break;
+    }
+}
+
+//Emits the children selected under each parent while walking the subtree in document order.
+void QDomCompatPathPlan::descend(const QDomNode &parent, const QDomCompatPathStep &step, const QDomCompatTextStore *texts, QVector<QDomNode> *out) const
+{
+    const QVector<QDomNode> selected = children(parent, step, texts);
+    int cursor = 0;
+    for(QDomNode child = parent.firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(cursor < selected.size() && child == selected.at(cursor)){
+            out->append(child);
+            cursor++;
+        }
+        if(child.isElement()){
+            descend(child, step, texts, out);
+        }
+    }
+}
+
+QVector<QDomNode> QDomCompatPathPlan::children(const QDomNode &parent, const QDomCompatPathStep &step, const QDomCompatTextStore *texts) const
+{
+    QVector<QDomNode> list;
+    for(QDomNode child = parent.firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(matches(child, step)){
+            list.append(child);
+        }
+    }
+    //each predicate sees the positions left by the previous one
+    for(const QDomCompatPathPredicate &predicate: step.predicates){
+        if(list.isEmpty()){
+            break;
+        }
+        list = filter(list, predicate, texts);
+    }
+    return list;
+}
+
+QVector<QDomNode> QDomCompatPathPlan::filter(const QVector<QDomNode> &list, const QDomCompatPathPredicate &predicate, const QDomCompatTextStore *texts) const
+{
+    QVector<QDomNode> result;
+    if(predicate.kind == QDomCompatPathPredicate::Position){
+        if(predicate.position >= 1 && predicate.position <= list.size()){
+            result.append(list.at(predicate.position - 1));
+        }
+    }else if(predicate.kind == QDomCompatPathPredicate::Last){
+        result.append(list.last());
+    }else{
+        for(const QDomNode &node: list){
+            if(accepts(node, predicate, texts)){
+                result.append(node);
+            }
+        }
+    }
+    return result;
+}
+
+bool QDomCompatPathPlan::accepts(const QDomNode &node, const QDomCompatPathPredicate &predicate, const QDomCompatTextStore *texts) const
+{
+    if(predicate.kind == QDomCompatPathPredicate::Attribute){
+        const QDomNode attr = attribute(node, predicate.name);
+        if(attr.isNull()){
+            return false;
+        }
+        return !predicate.compare || ((attr.nodeValue() == predicate.value) == predicate.equal);
+    }
+
+    for(QDomNode child = node.firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(child.isElement() && predicate.name.matches(child)){
+            if(!predicate.compare){
+                return true;
+            }
+            const QString value = texts != nullptr ? texts->elementText(child) : child.toElement().text();
+            if((value == predicate.value) == predicate.equal){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool QDomCompatPathPlan::matches(const QDomNode &node, const QDomCompatPathStep &step) const
+{
+    switch(step.test){
+    case QDomCompatPathStep::Name:
+        return node.isElement() && step.name.matches(node);
+    case QDomCompatPathStep::Text:
+        return node.isText();
+    case QDomCompatPathStep::AnyNode:
+        return true;
+    }
+    return false;
+}
+
+//QDomNamedNodeMap keeps the attributes in a list, so namedItemNS() and namedItem()
+//scan it too; going by name only saves building a QDomNode per attribute.
+QDomNode QDomCompatPathPlan::attribute(const QDomNode &element, const QDomCompatPathName &name) const
+{
+    if(!element.isElement()){
+        return QDomNode();
+    }
+    const QDomNamedNodeMap attrs = element.attributes();
+    if(name.bound){
+        const QDomNode attr = attrs.namedItemNS(name.namespaceURI, name.localName);
+        if(!attr.isNull()){
+            return attr;
+        }
+    }
+    const QDomNode attr = attrs.namedItem(name.qualifiedName);
+    if(!attr.isNull() && name.matches(attr)){
+        return attr;
+    }
+    return QDomNode();
+}
+
+QDomCompatPathParser::QDomCompatPathParser(const QString &expression, const QHash<QString, QString> &namespaces)
+    : text(expression)
+    , namespaces(namespaces)
+    , pos(0)
+{
+}
+
+bool QDomCompatPathParser::parse(QDomCompatPathPlan *plan)
+{
+    QDomCompatPathStep::Axis axis = QDomCompatPathStep::Child;
+    bool ok = true;
+
+    skipSpace();
+    if(atEnd()){
+        ok = fail(QStringLiteral("Empty expression"));
+    }else if(peek() == QLatin1Char('/')){
+        plan->absolute = true;
+        pos++;
+        if(peek() == QLatin1Char('/')){
+            pos++;
+            axis = QDomCompatPathStep::Descendant;
+        }else{
+            skipSpace();
+            if(atEnd()){
+                //the root node only
+                return true;
+            }
+        }
+    }
+
+    while(ok){
+        skipSpace();
+        QDomCompatPathStep step;
+        if(!parseStep(axis, &step)){
+            ok = false;
+            break;
+        }
+        plan->steps.append(step);
+
+        skipSpace();
+        if(atEnd()){
+            break;
+        }
+        if(step.axis == QDomCompatPathStep::Attribute){
+            ok = fail(QStringLiteral("An attribute step must be the last one"));
+        }else if(peek() != QLatin1Char('/')){
+            ok = fail(QStringLiteral("Unexpected character '%1'").arg(peek()));
+        }else{
+            pos++;
+            axis = QDomCompatPathStep::Child;
+            if(peek() == QLatin1Char('/')){
+                pos++;
+                axis = QDomCompatPathStep::Descendant;
+            }
+        }
+    }
+
+    if(!ok){
+        plan->errorString = error;
+        plan->steps.clear();
+    }
+    return ok;
+}
+
+bool QDomCompatPathParser::parseStep(QDomCompatPathStep::Axis axis, QDomCompatPathStep *step)
+{
+    if(peek() == QLatin1Char('.')){
+        if(axis == QDomCompatPathStep::Descendant){
+            return fail(QStringLiteral("'//' must be followed by a name test"));
+        }
+        step->test = QDomCompatPathStep::AnyNode;
+        if(peek(1) == QLatin1Char('.')){
+            pos += 2;
+            step->axis = QDomCompatPathStep::Parent;
+        }else{
+            pos++;
+            step->axis = QDomCompatPathStep::Self;
+        }
+        return true;
+    }
+
+    if(peek() == QLatin1Char('@')){
+        if(axis == QDomCompatPathStep::Descendant){
+            return fail(QStringLiteral("'//' must be followed by a name test"));
+        }
+        pos++;
+        step->axis = QDomCompatPathStep::Attribute;
+        step->test = QDomCompatPathStep::Name;
+        if(!parseName(&step->name, true)){
+            return false;
+        }
+        skipSpace();
+        if(peek() == QLatin1Char('[')){
+            return fail(QStringLiteral("Predicates on attributes are not supported"));
+        }
+        return true;
+    }
+
+    step->axis = axis;
+    QString function;
+    if(isFunction(&function)){
+        if(function == QLatin1String("text")){
+            step->test = QDomCompatPathStep::Text;
+        }else if(function == QLatin1String("node")){
+            step->test = QDomCompatPathStep::AnyNode;
+        }else{
+            return fail(QStringLiteral("Unsupported node test '%1()'").arg(function));
+        }
+        if(!parseFunction(function)){
+            return false;
+        }
+    }else{
+        step->test = QDomCompatPathStep::Name;
+        if(!parseName(&step->name, true)){
+            return false;
+        }
+    }
+
+    skipSpace();
+    while(peek() == QLatin1Char('[')){
+        QDomCompatPathPredicate predicate;
+        if(!parsePredicate(&predicate)){
+            return false;
+        }
+        step->predicates.append(predicate);
+        skipSpace();
+    }
+    return true;
+}
+
+bool QDomCompatPathParser::parsePredicate(QDomCompatPathPredicate *predicate)
+{
+    pos++;
+    skipSpace();
+
+    QString function;
+    if(peek().isDigit()){
+        const int start = pos;
+        while(peek().isDigit()){
+            pos++;
+        }
+        bool ok = false;
+        predicate->kind = QDomCompatPathPredicate::Position;
+        predicate->position = text.mid(start, pos - start).toInt(&ok);
+        if(!ok){
+            return fail(QStringLiteral("Invalid position"));
+        }
+
+    }else if(isFunction(&function)){
+        if(function != QLatin1String("last")){
+            return fail(QStringLiteral("Unsupported function '%1()'").arg(function));
+        }
+        if(!parseFunction(function)){
+            return false;
+        }
+        predicate->kind = QDomCompatPathPredicate::Last;
+
+    }else{
+        if(peek() == QLatin1Char('@')){
+            pos++;
+            predicate->kind = QDomCompatPathPredicate::Attribute;
+        }else{
+            predicate->kind = QDomCompatPathPredicate::Child;
+        }
+        if(!parseName(&predicate->name, false)){
+            return false;
+        }
+        skipSpace();
+        if(peek() == QLatin1Char('=') || (peek() == QLatin1Char('!') && peek(1) == QLatin1Char('='))){
+            predicate->compare = true;
+            predicate->equal = peek() == QLatin1Char('=');
+            pos += predicate->equal ? 1 : 2;
+            skipSpace();
+            if(!parseLiteral(&predicate->value)){
+                return false;
+            }
+        }
+    }
+
+    skipSpace();
+    if(peek() != QLatin1Char(']')){
+        return fail(QStringLiteral("Expected ']'"));
+    }
+    pos++;
+    return true;
+}
+
+bool QDomCompatPathParser::parseName(QDomCompatPathName *name, bool wildcard)
+{
+    QString first;
+    if(peek() == QLatin1Char('*')){
+        if(!wildcard){
+            return fail(QStringLiteral("Expected a name"));
+        }
+        pos++;
+        name->localName = QStringLiteral("*");
+        name->qualifiedName = name->localName;
+        return true;
+    }
+    if(!parseNCName(&first)){
+        return fail(QStringLiteral("Expected a name"));
+    }
+
+    if(peek() == QLatin1Char(':') && peek(1) != QLatin1Char(':')){
+        pos++;
+        name->prefix = first;
+        if(wildcard && peek() == QLatin1Char('*')){
+            pos++;
+            name->localName = QStringLiteral("*");
+        }else if(!parseNCName(&name->localName)){
+            return fail(QStringLiteral("Expected a local name"));
+        }
+        name->qualifiedName = name->prefix + QLatin1Char(':') + name->localName;
+
+        QHash<QString, QString>::const_iterator it = namespaces.constFind(name->prefix);
+        if(it != namespaces.constEnd()){
+            name->bound = true;
+            name->namespaceURI = it.value();
+        }
+    }else{
+        name->localName = first;
+        name->qualifiedName = first;
+    }
+    return true;
+}
+
+bool QDomCompatPathParser::parseNCName(QString *name)
+{
+    const int start = pos;
+    if(atEnd()){
+        return false;
+    }
+    const QChar first = peek();
+    if(!first.isLetter() && first != QLatin1Char('_') && first.unicode() < 0x80){
+        return false;
+    }
+    pos++;
+    while(!atEnd()){
+        const QChar ch = peek();
+        if(ch.isLetterOrNumber() || ch == QLatin1Char('_') || ch == QLatin1Char('-')
+                || ch == QLatin1Char('.') || ch.unicode() >= 0x80){
+            pos++;
+        }else{
+            break;
+        }
+    }
+    *name = text.mid(start, pos - start);
+    return true;
+}
+
+//The name is already consumed, the empty argument list follows.
+bool QDomCompatPathParser::parseFunction(const QString &name)
+{
+    skipSpace();
+    if(peek() != QLatin1Char('(')){
+        return fail(QStringLiteral("Expected '(' after '%1'").arg(name));
+    }
+    pos++;
+    skipSpace();
+    if(peek() != QLatin1Char(')')){
+        return fail(QStringLiteral("Expected ')' after '%1('").arg(name));
+    }
+    pos++;
+    return true;
+}
+
+bool QDomCompatPathParser::parseLiteral(QString *value)
+{
+    const QChar quote = peek();
+    if(quote != QLatin1Char('\'') && quote != QLatin1Char('\"')){
+        return fail(QStringLiteral("Expected a quoted string"));
+    }
+    const int end = text.indexOf(quote, pos + 1);
+    if(end < 0){
+        return fail(QStringLiteral("Unterminated string"));
+    }
+    *value = text.mid(pos + 1, end - pos - 1);
+    pos = end + 1;
+    return true;
+}
+
+//A name followed by '(' is a function or node test, the position is left after the name then.
+bool QDomCompatPathParser::isFunction(QString *name)
+{
+    const int start = pos;
+    if(parseNCName(name)){
+        skipSpace();
+        if(peek() == QLatin1Char('(')){
+            return true;
+        }
+    }
+    pos = start;
+    return false;
+}
+
+void QDomCompatPathParser::skipSpace()
+{
+    while(!atEnd() && peek().isSpace()){
+        pos++;
+    }
+}
+
+bool QDomCompatPathParser::atEnd() const
+{
+    return pos >= text.length();
+}
+
+QChar QDomCompatPathParser::peek(int offset) const
+{
+    return pos + offset < text.length() ? text.at(pos + offset) : QChar();
+}
+
+bool QDomCompatPathParser::fail(const QString &message)
+{
+    if(error.isEmpty()){
+        error = QStringLiteral("%1 at position %2").arg(message).arg(pos);
+    }
+    return false;
+}
+
+QDomCompatPath::QDomCompatPath()
+{
+}
+
+QDomCompatPath::QDomCompatPath(const QString &expression, const QHash<QString, QString> &namespaces)
+{
+    const QString key = cacheKey(expression, namespaces);
+    QDomCompatPathCache *cache = pathCache();
+    {
+        QMutexLocker locker(&cache->mutex);
+        const QHash<QString, QDomCompatPathCacheEntry>::iterator it = cache->plans.find(key);
+        if(it != cache->plans.end()){
+            it->used = ++cache->tick;
+            plan = it->plan;
+        }
+    }
+    if(!plan.isNull()){
+        return;
+    }
+
+    //compiled outside the lock, a concurrent compile of the same path only costs time
+    QSharedPointer<QDomCompatPathPlan> compiled(new QDomCompatPathPlan());
+    compiled->expression = expression;
+    QDomCompatPathParser(expression, namespaces).parse(compiled.data());
+    plan = compiled;
+
+    QMutexLocker locker(&cache->mutex);
+    if(cache->plans.size() >= CacheLimit && !cache->plans.contains(key)){
+        QHash<QString, QDomCompatPathCacheEntry>::iterator oldest = cache->plans.begin();
+        for(QHash<QString, QDomCompatPathCacheEntry>::iterator it = cache->plans.begin(); it != cache->plans.end(); ++it){
+            if(it->used < oldest->used){
+                oldest = it;
+            }
+        }
+        cache->plans.erase(oldest);
+    }
+    QDomCompatPathCacheEntry entry;
+    entry.plan = plan;
+    entry.used = ++cache->tick;
+    cache->plans.insert(key, entry);
+}
+
+bool QDomCompatPath::isValid() const
+{
+    return !plan.isNull() && plan->errorString.isEmpty();
+}
+
+QString QDomCompatPath::expression() const
+{
+    return plan.isNull() ? QString() : plan->expression;
+}
+
+QString QDomCompatPath::errorString() const
+{
+    return plan.isNull() ? QString() : plan->errorString;
+}
+
+QVector<QDomNode> QDomCompatPath::evaluate(const QDomNode &context) const
+{
+    if(plan.isNull()){
+        return QVector<QDomNode>();
+    }
+    return plan->evaluate(context);
+}
+
+QVector<QDomCompatFrozenNode> QDomCompatPath::evaluate(const QDomCompatFrozenNode &context) const
+{
+    QVector<QDomCompatFrozenNode> result;
+    if(plan.isNull() || context.isNull()){
+        return result;
+    }
+    const QVector<int> list = context.d->evaluate(*plan, context.i);
+    result.reserve(list.size());
+    for(int index: list){
+        result.append(QDomCompatFrozenNode(context.d, index));
+    }
+    return result;
+}
+
+void QDomCompatPath::clearCache()
+{
+    QDomCompatPathCache *cache = pathCache();
+    QMutexLocker locker(&cache->mutex);
+    cache->plans.clear();
+}
@@ -0,0 +1,42 @@
+#ifndef QDOMCOMPATPATH_H
+#define QDOMCOMPATPATH_H
+
+#include "qtxmlcompat_global.h"
+#include "qdomcompatfrozen.h"
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QVector>
+#include <QtXml/QDomNode>
+
+class QDomCompatPathPlan;
+
+// Compiled location path, a subset of XPath 1.0:
+//   /a/b, a//b, //b, ., .., *, p:*, text(), node(), @name, @*
+//   predicates [n], [last()], [@a], [@a='v'], [@a!='v'], [b], [b='v']
+// Prefixes are resolved with the given bindings. Compiled plans are cached per
+// expression and bindings, so constructing the same path again is cheap.
+class QTXMLCOMPAT_EXPORT QDomCompatPath
+{
+public:
+    QDomCompatPath();
+    explicit QDomCompatPath(const QString &expression, const QHash<QString, QString> &namespaces = QHash<QString, QString>());
+
+    bool isValid() const;
+    QString expression() const;
+    QString errorString() const;
+
+    // Matches in document order, without duplicates. Compacted text is empty to a
+    // plain node, QDomDocumentCompat::select() compares it by textValue().
+    QVector<QDomNode> evaluate(const QDomNode &context) const;
+    QVector<QDomCompatFrozenNode> evaluate(const QDomCompatFrozenNode &context) const;
+
+    static void clearCache();
+
+private:
+    friend class QDomDocumentCompat;
+
+    QSharedPointer<const QDomCompatPathPlan> plan;
+};
+
+#endif // QDOMCOMPATPATH_H
@@ -0,0 +1,113 @@
+#ifndef QDOMCOMPATPATH_P_H
+#define QDOMCOMPATPATH_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomcompatpath.h"
+
+class QDomCompatTextStore;
+
+struct QDomCompatPathName {
+    QString prefix;
+    QString localName;          // "*" for any
+    QString qualifiedName;
+    QString namespaceURI;
+    bool bound;                 // prefix found in the bindings
+
+    QDomCompatPathName() : bound(false) {}
+
+    bool matches(const QDomNode &node) const;
+};
+
+struct QDomCompatPathPredicate {
+    enum Kind {
+        Position,
+        Last,
+        Attribute,              // [@a], [@a='v'], [@a!='v']
+        Child                   // [b], [b='v']
+    };
+
+    Kind kind;
+    int position;
+    QDomCompatPathName name;
+    bool compare;
+    bool equal;
+    QString value;
+
+    QDomCompatPathPredicate() : kind(Position), position(0), compare(false), equal(true) {}
+};
+
+struct QDomCompatPathStep {
+    enum Axis {
+        Child,
+        Descendant,             // descendant-or-self::node()/child::
+        Self,
+        Parent,
+        Attribute
+    };
+    enum Test {
+        Name,
+        Text,
+        AnyNode
+    };
+
+    Axis axis;
+    Test test;
+    QDomCompatPathName name;
+    QVector<QDomCompatPathPredicate> predicates;
+
+    QDomCompatPathStep() : axis(Child), test(Name) {}
+};
+
+class QDomCompatPathPlan
+{
+public:
+    QString expression;
+    QString errorString;
+    bool absolute;
+    QVector<QDomCompatPathStep> steps;
+
+    QDomCompatPathPlan() : absolute(false) {}
+
+    // Child value predicates read compacted text through the store, if given.
+    QVector<QDomNode> evaluate(const QDomNode &context, const QDomCompatTextStore *texts = nullptr) const;
+
+private:
+    void select(const QDomNode &node, const QDomCompatPathStep &step, const QDomCompatTextStore *texts, QVector<QDomNode> *out) const;
+    void descend(const QDomNode &parent, const QDomCompatPathStep &step, const QDomCompatTextStore *texts, QVector<QDomNode> *out) const;
+    QVector<QDomNode> children(const QDomNode &parent, const QDomCompatPathStep &step, const QDomCompatTextStore *texts) const;
+    QVector<QDomNode> filter(const QVector<QDomNode> &list, const QDomCompatPathPredicate &predicate, const QDomCompatTextStore *texts) const;
+    bool accepts(const QDomNode &node, const QDomCompatPathPredicate &predicate, const QDomCompatTextStore *texts) const;
+    bool matches(const QDomNode &node, const QDomCompatPathStep &step) const;
+    QDomNode attribute(const QDomNode &element, const QDomCompatPathName &name) const;
+};
+
+// Recursive descent over the supported grammar.
+class QDomCompatPathParser
+{
+public:
+    QDomCompatPathParser(const QString &expression, const QHash<QString, QString> &namespaces);
+
+    bool parse(QDomCompatPathPlan *plan);
+
+private:
+    const QString &text;
+    const QHash<QString, QString> &namespaces;
+    int pos;
+    QString error;
+
+    bool parseStep(QDomCompatPathStep::Axis axis, QDomCompatPathStep *step);
+    bool parsePredicate(QDomCompatPathPredicate *predicate);
+    bool parseName(QDomCompatPathName *name, bool wildcard);
+    bool parseNCName(QString *name);
+    bool parseFunction(const QString &name);
+    bool parseLiteral(QString *value);
+    bool isFunction(QString *name);
+
+    void skipSpace();
+    bool atEnd() const;
+    QChar peek(int offset = 0) const;
+    bool fail(const QString &message);
+};
+
+#endif // QDOMCOMPATPATH_P_H
@@ -0,0 +1,243 @@
+#include "qdomcompatrecords_p.h"
+
+#include <QThreadPool>
+
+QDomCompatRecordTask::QDomCompatRecordTask(const QDomCompatRecord &record, const std::function<void(const QDomCompatRecord &)> &process, QSemaphore *queue)
+    : record(record)
+    , process(process)
+    , queue(queue)
+{
+}
+
+void QDomCompatRecordTask::run()
+{
+    process(record);
+    //the tree is freed on this thread, not by the parse
+    record = QDomCompatRecord();
+    queue->release();
+}
+
+QDomCompatRecordSplitter::QDomCompatRecordSplitter(const QDomDocumentCompat &options, const QString &recordName, bool namespaceProcessing,
+                                                   const std::function<void(const QDomCompatRecord &)> &process, QThreadPool *pool, int queueDepth)
+    : QXmlDefaultHandler()
+    , options(options)
+    , recordName(recordName)
+    , namespaceProcessing(namespaceProcessing)
+    , process(process)
+    , pool(pool)
+    , queueDepth(queueDepth)
+    , queue(queueDepth)
+    , locator(nullptr)
+    , handler(nullptr)
+    , depth(0)
+    , count(0)
+{
+}
+
+QDomCompatRecordSplitter::~QDomCompatRecordSplitter()
+{
+    //the tasks refer to the callback
+    finish();
+}
+
+void QDomCompatRecordSplitter::finish()
+{
+    queue.acquire(queueDepth);
+    queue.release(queueDepth);
+}
+
+void QDomCompatRecordSplitter::setDocumentLocator(QXmlLocator *locator)
+{
+    this->locator = locator;
+    QXmlDefaultHandler::setDocumentLocator(locator);
+}
+
+bool QDomCompatRecordSplitter::startPrefixMapping(const QString &prefix, const QString &uri)
+{
+    //within a record the elements carry their namespace URIs
+    if(handler == nullptr){
+        pendingDeclarations.append(qMakePair(prefix, uri));
+    }
+    return true;
+}
+
+bool QDomCompatRecordSplitter::startElement(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts)
+{
+    if(handler != nullptr){
+        depth++;
+        return forward(handler->startElement(namespaceURI, localName, qName, atts));
+    }
+
+    //without namespace processing the declarations are plain attributes
+    int declared = 0;
+    if(namespaceProcessing){
+        declarations += pendingDeclarations;
+        declared = pendingDeclarations.size();
+        pendingDeclarations.clear();
+    }else{
+        for(int i=0; i<atts.length(); i++){
+            const QString name = atts.qName(i);
+            if(name == QLatin1String("xmlns")){
+                declarations.append(qMakePair(QString(), atts.value(i)));
+                declared++;
+            }else if(name.startsWith(QLatin1String("xmlns:"))){
+                declarations.append(qMakePair(name.mid(6), atts.value(i)));
+                declared++;
+            }
+        }
+    }
+    declarationCounts.append(declared);
+
+    if(qName == recordName){
+        return startRecord(namespaceURI, localName, qName, atts);
+    }
+    return true;
+}
+
+bool QDomCompatRecordSplitter::endElement(const QString &namespaceURI, const QString &localName, const QString &qName)
+{
+    if(handler != nullptr){
+        if(!forward(handler->endElement(namespaceURI, localName, qName))){
+            return false;
+        }
+        if(--depth > 0){
+            return true;
+        }
+        if(!endRecord()){
+            return false;
+        }
+    }
+    if(!declarationCounts.isEmpty()){
+        declarations.resize(declarations.size() - declarationCounts.takeLast());
+    }
+    return true;
+}
+
+bool QDomCompatRecordSplitter::characters(const QString &ch)
+{
+    //text between the records isn't kept
+    return handler == nullptr || forward(handler->characters(ch));
+}
+
+bool QDomCompatRecordSplitter::ignorableWhitespace(const QString &ch)
+{
+    return handler == nullptr || forward(handler->ignorableWhitespace(ch));
+}
+
+bool QDomCompatRecordSplitter::processingInstruction(const QString &target, const QString &data)
+{
+    return handler == nullptr || forward(handler->processingInstruction(target, data));
+}
+
+bool QDomCompatRecordSplitter::skippedEntity(const QString &name)
+{
+    return handler == nullptr || forward(handler->skippedEntity(name));
+}
+
+QString QDomCompatRecordSplitter::errorString() const
+{
+    return m_errorString;
+}
+
+bool QDomCompatRecordSplitter::startEntity(const QString &name)
+{
+    return handler == nullptr || forward(handler->startEntity(name));
+}
+
+bool QDomCompatRecordSplitter::endEntity(const QString &name)
+{
+    return handler == nullptr || forward(handler->endEntity(name));
+}
+
+bool QDomCompatRecordSplitter::startCDATA()
+{
+    return handler == nullptr || forward(handler->startCDATA());
+}
+
+bool QDomCompatRecordSplitter::endCDATA()
+{
+    return handler == nullptr || forward(handler->endCDATA());
+}
+
+bool QDomCompatRecordSplitter::comment(const QString &ch)
+{
+    return handler == nullptr || forward(handler->comment(ch));
+}
+
+bool QDomCompatRecordSplitter::fatalError(const QXmlParseException &exception)
+{
+    m_errorInfo.message = exception.message();
+    m_errorInfo.lineNumber = exception.lineNumber();
+    m_errorInfo.columnNumber = exception.columnNumber();
+    return QXmlDefaultHandler::fatalError(exception);
+}
+
+const ErrorInfo &QDomCompatRecordSplitter::errorInfo() const
+{
+    return m_errorInfo;
+}
+
+bool QDomCompatRecordSplitter::startRecord(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts)
+{
+    //the options only, like setContentAsync()
+    record.index = count;
+    record.document.setCompactTextThreshold(options.compactTextThreshold());
+    record.document.setCompression(options.compression());
+    record.document.setElementIndexEnabled(options.isElementIndexEnabled());
+    record.document.setIdAttributes(options.idAttributes());
+    record.document.setParseLimits(options.parseLimits());
+    //records keep all of their whitespace, the dropped gaps are framed from the document
+    //element down and the splitter starts a record below it
+    record.document.setWhitespacePolicy(QDomDocumentCompat::KeepWhitespace);
+    for(const QPair<QString, QString> &declaration: declarations){
+        record.namespaces.insert(declaration.first, declaration.second);
+    }
+
+    handler = record.document.startParse(namespaceProcessing);
+    if(locator != nullptr){
+        handler->setDocumentLocator(locator);
+    }
+    if(!forward(handler->startDocument())){
+        return false;
+    }
+
+    QXmlAttributes attributes = atts;
+    if(!namespaceProcessing){
+        //declarations of the ancestors, innermost first, so the record parses on its own
+        const int outer = declarations.size() - declarationCounts.last();
+        for(int i=outer - 1; i>=0; i--){
+            const QString name = declarations.at(i).first.isEmpty() ? QStringLiteral("xmlns") : QStringLiteral("xmlns:") + declarations.at(i).first;
+            if(attributes.index(name) < 0){
+                attributes.append(name, QString(), QString(), declarations.at(i).second);
+            }
+        }
+    }
+    depth = 1;
+    return forward(handler->startElement(namespaceURI, localName, qName, attributes));
+}
+
+bool QDomCompatRecordSplitter::endRecord()
+{
+    if(!forward(handler->endDocument())){
+        return false;
+    }
+    handler = nullptr;
+
+    QDomCompatRecordTask *task = new QDomCompatRecordTask(record, process, &queue);
+    //drops the handler and this thread's references to the tree
+    record = QDomCompatRecord();
+    count++;
+
+    //waits while the queue is full
+    queue.acquire();
+    pool->start(task);
+    return true;
+}
+
+bool QDomCompatRecordSplitter::forward(bool ok)
+{
+    if(!ok){
+        m_errorString = handler->errorString();
+    }
+    return ok;
+}
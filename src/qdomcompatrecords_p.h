@@ -0,0 +1,89 @@
+#ifndef QDOMCOMPATRECORDS_P_H
+#define QDOMCOMPATRECORDS_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+#include "qdomdocumentcompat_p.h"
+#include <QPair>
+#include <QRunnable>
+#include <QSemaphore>
+
+// Hands one record to the callback on a pool thread, then frees its queue slot.
+class QDomCompatRecordTask : public QRunnable
+{
+public:
+    QDomCompatRecordTask(const QDomCompatRecord &record, const std::function<void(const QDomCompatRecord &)> &process, QSemaphore *queue);
+
+    void run() override;
+
+private:
+    QDomCompatRecord record;
+    std::function<void(const QDomCompatRecord &)> process;
+    QSemaphore *queue;
+};
+
+// Reader handler of processRecords(). Outside the records it only tracks the
+// namespace declarations in scope. Inside one it forwards the events to the
+// QXmlSimpleHandler of the record's document, which builds it like setContent().
+class QDomCompatRecordSplitter : public QXmlDefaultHandler
+{
+public:
+    QDomCompatRecordSplitter(const QDomDocumentCompat &options, const QString &recordName, bool namespaceProcessing,
+                             const std::function<void(const QDomCompatRecord &)> &process, QThreadPool *pool, int queueDepth);
+    ~QDomCompatRecordSplitter();
+
+    // Waits for the records handed out so far.
+    void finish();
+
+    //QXmlContentHandler
+    void setDocumentLocator(QXmlLocator *locator) override;
+    bool startPrefixMapping(const QString &prefix, const QString &uri) override;
+    bool startElement(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts) override;
+    bool endElement(const QString &namespaceURI, const QString &localName, const QString &qName) override;
+    bool characters(const QString &ch) override;
+    bool ignorableWhitespace(const QString &ch) override;
+    bool processingInstruction(const QString &target, const QString &data) override;
+    bool skippedEntity(const QString &name) override;
+    QString errorString() const override;
+
+    //QXmlLexicalHandler
+    bool startEntity(const QString &name) override;
+    bool endEntity(const QString &name) override;
+    bool startCDATA() override;
+    bool endCDATA() override;
+    bool comment(const QString &ch) override;
+
+    //QXmlErrorHandler
+    bool fatalError(const QXmlParseException &exception) override;
+
+    const ErrorInfo &errorInfo() const;
+
+private:
+    const QDomDocumentCompat &options;
+    QString recordName;
+    bool namespaceProcessing;
+    std::function<void(const QDomCompatRecord &)> process;
+    QThreadPool *pool;
+    int queueDepth;
+    QSemaphore queue;           // free slots of the queue
+    QXmlLocator *locator;
+
+    QVector<QPair<QString, QString>> declarations;          // prefix and URI, innermost last
+    QVector<int> declarationCounts;                         // per open element up to the record element
+    QVector<QPair<QString, QString>> pendingDeclarations;   // reported before their element
+
+    QDomCompatRecord record;
+    QXmlSimpleHandler *handler;     // of record.document, null outside a record
+    int depth;                      // within the record
+    qint64 count;
+
+    ErrorInfo m_errorInfo;
+    QString m_errorString;
+
+    bool startRecord(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts);
+    bool endRecord();
+    bool forward(bool ok);
+};
+
+#endif // QDOMCOMPATRECORDS_P_H
@@ -0,0 +1,181 @@
+#include "qdomcompatsource_p.h"
+
+QDomCompatViewSource::QDomCompatViewSource(QStringView text)
+    : QXmlInputSource()
+    , utf16(text.data())
+    , utf8(nullptr)
+    , size(text.size())
+    , start(0)
+    , pos(0)
+    , lowSurrogate(0)
+    , endOfData(false)
+{
+}
+
+QDomCompatViewSource::QDomCompatViewSource(const char *data, qsizetype size)
+    : QXmlInputSource()
+    , utf16(nullptr)
+    , utf8(reinterpret_cast<const uchar *>(data))
+    , size(size)
+    , start(0)
+    , pos(0)
+    , lowSurrogate(0)
+    , endOfData(false)
+{
+    if(size >= 3 && utf8[0] == 0xef && utf8[1] == 0xbb && utf8[2] == 0xbf){
+        start = 3;
+        pos = 3;
+    }
+}
+
+bool QDomCompatViewSource::isUtf8(const char *data, qsizetype size)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    if(size >= 2){
+        //UTF-16 with or without a byte order mark
+        if((bytes[0] == 0xfe && bytes[1] == 0xff) || (bytes[0] == 0xff && bytes[1] == 0xfe)
+                || bytes[0] == 0 || bytes[1] == 0){
+            return false;
+        }
+    }
+    qsizetype from = 0;
+    if(size >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf){
+        from = 3;
+    }
+
+    //the declaration is at the very beginning, its length is bounded in practice
+    const QByteArray head = QByteArray::fromRawData(data + from, int(qMin<qsizetype>(size - from, 256)));
+    if(!head.startsWith("<?xml")){
+        return true;
+    }
+    int end = head.indexOf("?>");
+    if(end < 0){
+        end = head.size();
+    }
+    int i = head.indexOf("encoding");
+    if(i < 0 || i > end){
+        return true;
+    }
+    i += 8;
+    while(i < end && (head.at(i) == ' ' || head.at(i) == '\t' || head.at(i) == '\r' || head.at(i) == '\n' || head.at(i) == '=')){
+        i++;
+    }
+    if(i >= end || (head.at(i) != '"' && head.at(i) != '\'')){
+        return true;
+    }
+    const int close = head.indexOf(head.at(i), i + 1);
+    if(close < 0 || close > end){
+        return true;
+    }
+    const QByteArray name = head.mid(i + 1, close - i - 1).toLower();
+    return name == "utf-8" || name == "utf8";
+}
+
+QChar QDomCompatViewSource::next()
+{
+    if(lowSurrogate != 0){
+        const QChar ch(lowSurrogate);
+        lowSurrogate = 0;
+        return ch;
+    }
+    if(pos >= size){
+        return end();
+    }
+    QChar ch;
+    if(utf16 != nullptr){
+        ch = utf16[pos++];
+    }else if(utf8[pos] < 0x80){
+        ch = QChar(ushort(utf8[pos++]));
+    }else{
+        ch = decode();
+    }
+    //Same as QXmlInputSource, the reader would take this for the end of the buffer.
+    if(ch.unicode() == EndOfData){
+        ch = QChar(ushort(EndOfDocument));
+    }
+    return ch;
+}
+
+void QDomCompatViewSource::reset()
+{
+    pos = start;
+    lowSurrogate = 0;
+    endOfData = false;
+}
+
+void QDomCompatViewSource::fetchData()
+{
+    //all of it is there from the start
+}
+
+QString QDomCompatViewSource::data() const
+{
+    //not used by the reader, a copy for other callers
+    if(utf16 != nullptr){
+        return QString(utf16, int(size));
+    }
+    return QString::fromUtf8(reinterpret_cast<const char *>(utf8 + start), int(size - start));
+}
+
+qsizetype QDomCompatViewSource::position() const
+{
+    return pos;
+}
+
+//One sequence starting at a byte >= 0x80, malformed ones become U+FFFD and consume one byte.
+QChar QDomCompatViewSource::decode()
+{
+    const uchar lead = utf8[pos];
+    int length;
+    uint ucs;
+    uint minimum;
+    if((lead & 0xe0) == 0xc0){
+        length = 2;
+        ucs = lead & 0x1f;
+        minimum = 0x80;
+    }else if((lead & 0xf0) == 0xe0){
+        length = 3;
+        ucs = lead & 0x0f;
+        minimum = 0x800;
+    }else if((lead & 0xf8) == 0xf0){
+        length = 4;
+        ucs = lead & 0x07;
+        minimum = 0x10000;
+    }else{
+        pos++;
+        return QChar(QChar::ReplacementCharacter);
+    }
+    if(pos + length > size){
+        pos++;
+        return QChar(QChar::ReplacementCharacter);
+    }
+    for(int i=1; i<length; i++){
+        const uchar byte = utf8[pos + i];
+        if((byte & 0xc0) != 0x80){
+            pos++;
+            return QChar(QChar::ReplacementCharacter);
+        }
+        ucs = (ucs << 6) | (byte & 0x3f);
+    }
+    if(ucs < minimum || ucs > 0x10ffff || (ucs >= 0xd800 && ucs <= 0xdfff)){
+        pos++;
+        return QChar(QChar::ReplacementCharacter);
+    }
+    pos += length;
+    if(ucs > 0xffff){
+        lowSurrogate = QChar::lowSurrogate(ucs);
+        return QChar(QChar::highSurrogate(ucs));
+    }
+    return QChar(ushort(ucs));
+}
+
+//EndOfData first, then EndOfDocument, like QXmlInputSource::next() without more data to fetch.
+QChar QDomCompatViewSource::end()
+{
+    if(endOfData){
+        endOfData = false;
+        return QChar(ushort(EndOfDocument));
+    }
+    endOfData = true;
+    return QChar(ushort(EndOfData));
+}
@@ -0,0 +1,40 @@
+#ifndef QDOMCOMPATSOURCE_P_H
+#define QDOMCOMPATSOURCE_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+
+// Hands the characters of a caller's buffer to the reader one by one, without
+// the UTF-16 copy QXmlInputSource::setData() makes. UTF-8 is decoded as the
+// reader asks for it. The buffer must stay alive and unchanged while parsing.
+class QDomCompatViewSource : public QXmlInputSource
+{
+public:
+    explicit QDomCompatViewSource(QStringView text);
+    QDomCompatViewSource(const char *data, qsizetype size);
+
+    // True unless a byte order mark or the XML declaration names another encoding.
+    static bool isUtf8(const char *data, qsizetype size);
+
+    QChar next() override;
+    void reset() override;
+    void fetchData() override;
+    QString data() const override;
+
+    qsizetype position() const;
+
+private:
+    const QChar *utf16;
+    const uchar *utf8;
+    qsizetype size;
+    qsizetype start;        // after the byte order mark
+    qsizetype pos;
+    ushort lowSurrogate;    // second half of a character above U+FFFF
+    bool endOfData;
+
+    QChar decode();
+    QChar end();
+};
+
+#endif // QDOMCOMPATSOURCE_P_H
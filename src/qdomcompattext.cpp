@@ -0,0 +1,182 @@
+#include "qdomcompattext_p.h"
+
+#if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+#include <QTextCodec>
+#endif
+
+QDomCompatTextStore::QDomCompatTextStore()
+{
+    marker.reserve(1);
+}
+
+bool QDomCompatTextStore::insert(const QDomNode &node, const QString &text)
+{
+    Payload payload;
+    payload.node = node;
+
+    bool latin1 = true;
+    for(const QChar &ch: text){
+        if(ch.unicode() > 0xff){
+            latin1 = false;
+            break;
+        }
+    }
+    if(latin1){
+        payload.data = text.toLatin1();
+        payload.utf8 = false;
+    }else{
+        payload.data = text.toUtf8();
+        payload.utf8 = true;
+        if(payload.data.size() >= text.size() * 2){
+            //mostly CJK and the like, UTF-16 is smaller
+            return false;
+        }
+    }
+
+    payload.node.setNodeValue(marker);
+    payloads.insert(QDomCompatNodeAccess::identity(node), payload);
+    return true;
+}
+
+bool QDomCompatTextStore::contains(const QDomNode &node) const
+{
+    return find(node) != nullptr;
+}
+
+QString QDomCompatTextStore::text(const QDomNode &node) const
+{
+    const Payload *payload = find(node);
+    if(payload == nullptr){
+        return node.nodeValue();
+    }
+    return decode(*payload);
+}
+
+QString QDomCompatTextStore::elementText(const QDomNode &node) const
+{
+    if(node.isText()){
+        return text(node);
+    }
+    QString result;
+    for(QDomNode child = node.firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(child.isText() || child.isElement()){
+            result += elementText(child);
+        }
+    }
+    return result;
+}
+
+bool QDomCompatTextStore::save(QTextStream &s, const QDomNode &node, int indent) const
+{
+    const Payload *payload = find(node);
+    if(payload == nullptr){
+        return false;
+    }
+
+    if(node.isCDATASection()){
+        s << QStringLiteral("<![CDATA[");
+        write(s, *payload, 0, payload->data.size());
+        s << QStringLiteral("]]>");
+        return true;
+    }
+
+#if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+    //QDomText writes characters the codec can't encode as references, leave other codecs to it.
+    if(s.codec() != nullptr && s.codec()->mibEnum() != 106){
+        node.ownerDocument().createTextNode(decode(*payload)).save(s, indent);
+        return true;
+    }
+#else
+    Q_UNUSED(indent)
+#endif
+
+    //Same escapes as QDomText, all of them ASCII, so a byte scan works for both encodings.
+    //Runs without markup characters are written as they are.
+    const char *data = payload->data.constData();
+    const int size = payload->data.size();
+    int from = 0;
+    for(int i=0; i<size; i++){
+        const char ch = data[i];
+        QLatin1String entity;
+        if(ch == '<'){
+            entity = QLatin1String("&lt;");
+        }else if(ch == '&'){
+            entity = QLatin1String("&amp;");
+        }else if(ch == '>' && i >= 2 && data[i-1] == ']' && data[i-2] == ']'){
+            entity = QLatin1String("&gt;");
+        }else if(ch == '\r'){
+            entity = QLatin1String("&#xd;");
+        }else{
+            continue;
+        }
+        write(s, *payload, from, i);
+        s << entity;
+        from = i + 1;
+    }
+    write(s, *payload, from, size);
+    return true;
+}
+
+void QDomCompatTextStore::expand()
+{
+    for(QHash<const void *, Payload>::iterator it = payloads.begin(); it != payloads.end(); ++it){
+        if(isMarked(it->node)){
+            it->node.setNodeValue(decode(*it));
+        }
+    }
+    payloads.clear();
+}
+
+void QDomCompatTextStore::prune()
+{
+    for(QHash<const void *, Payload>::iterator it = payloads.begin(); it != payloads.end();){
+        QDomNode root = it->node;
+        while(!root.parentNode().isNull()){
+            root = root.parentNode();
+        }
+        if(!isMarked(it->node) || !root.isDocument()){
+            it = payloads.erase(it);
+        }else{
+            ++it;
+        }
+    }
+}
+
+const QDomCompatTextStore::Payload *QDomCompatTextStore::find(const QDomNode &node) const
+{
+    QHash<const void *, Payload>::const_iterator it = payloads.constFind(QDomCompatNodeAccess::identity(node));
+    if(it == payloads.constEnd() || !isMarked(node)){
+        return nullptr;
+    }
+    return &it.value();
+}
+
+//Any value set on the node, an empty one too, is another string than the marker.
+bool QDomCompatTextStore::isMarked(const QDomNode &node) const
+{
+    return node.nodeValue().constData() == marker.constData();
+}
+
+QString QDomCompatTextStore::decode(const Payload &payload) const
+{
+    return payload.utf8 ? QString::fromUtf8(payload.data) : QString::fromLatin1(payload.data);
+}
+
+//Converts in small chunks so that the stream never sees the whole payload as UTF-16.
+void QDomCompatTextStore::write(QTextStream &s, const Payload &payload, int from, int to) const
+{
+    const char *data = payload.data.constData();
+    while(from < to){
+        int length = qMin(int(ChunkSize), to - from);
+        if(payload.utf8){
+            //don't split a multi-byte sequence
+            while(from + length < to && length > 1 && (uchar(data[from + length]) & 0xc0) == 0x80){
+                length--;
+            }
+            s << QString::fromUtf8(data + from, length);
+        }else{
+            s << QLatin1String(data + from, length);
+        }
+        from += length;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef QDOMCOMPATTEXT_P_H
+#define QDOMCOMPATTEXT_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+
+// Identity of the shared node data, equal for every QDomNode handle of the same node.
+struct QDomCompatNodeAccess : public QDomNode
+{
+    static const void *identity(const QDomNode &node)
+    {
+        return node.*(&QDomCompatNodeAccess::impl);
+    }
+};
+
+// Character data of large text and CDATA nodes held as Latin-1 or UTF-8 bytes.
+// The nodes stay in the tree with an empty marker value. The marker is one
+// string shared by all of them, so once a node gets any value of its own
+// (setNodeValue(), even an empty one) that value wins over the stored one.
+class QDomCompatTextStore
+{
+public:
+    QDomCompatTextStore();
+
+    // Returns false if the text wouldn't get smaller, the node is left alone then.
+    bool insert(const QDomNode &node, const QString &text);
+    bool contains(const QDomNode &node) const;
+    QString text(const QDomNode &node) const;
+    // Text and CDATA below the node, like QDomElement::text().
+    QString elementText(const QDomNode &node) const;
+
+    // Writes the node like QDomText::save()/QDomCDATASection::save() do,
+    // false if the node isn't stored here.
+    bool save(QTextStream &s, const QDomNode &node, int indent) const;
+
+    // Moves the data back into the nodes.
+    void expand();
+    // Drops the data of nodes that got a value of their own or are no longer
+    // below a document node.
+    void prune();
+
+private:
+    enum { ChunkSize = 16384 };
+
+    struct Payload {
+        QDomNode node;      // keeps the node data, and so its identity, alive
+        QByteArray data;
+        bool utf8;
+    };
+    QHash<const void *, Payload> payloads;
+    QString marker;         // empty, with a buffer of its own to compare against
+
+    const Payload *find(const QDomNode &node) const;
+    bool isMarked(const QDomNode &node) const;
+    QString decode(const Payload &payload) const;
+    void write(QTextStream &s, const Payload &payload, int from, int to) const;
+};
+
+#endif // QDOMCOMPATTEXT_P_H
@@ -0,0 +1,43 @@
+#include "qdomcompatwhitespace_p.h"
+#include "qdomcompattext_p.h"
+
+bool QDomCompatWhitespaceStore::isWhitespace(const QString &text)
+{
+    if(text.isEmpty()){
+        return false;
+    }
+    //'\r' only reaches here as a character reference, which QDomText writes escaped
+    for(const QChar &ch: text){
+        if(ch != QLatin1Char(' ') && ch != QLatin1Char('\n') && ch != QLatin1Char('\t')){
+            return false;
+        }
+    }
+    return true;
+}
+
+void QDomCompatWhitespaceStore::insert(const QDomNode &element, const QVector<QString> &gaps)
+{
+    Entry entry;
+    entry.element = element;
+    entry.gaps = gaps;
+    entries.insert(QDomCompatNodeAccess::identity(element), entry);
+}
+
+const QVector<QString> *QDomCompatWhitespaceStore::gaps(const QDomNode &element) const
+{
+    QHash<const void *, Entry>::const_iterator it = entries.constFind(QDomCompatNodeAccess::identity(element));
+    if(it == entries.constEnd()){
+        return nullptr;
+    }
+    int count = 0;
+    for(QDomNode child = element.firstChild(); !child.isNull(); child = child.nextSibling()){
+        if(!child.isElement()){
+            return nullptr;
+        }
+        count++;
+    }
+    if(count + 1 != it->gaps.size()){
+        return nullptr;
+    }
+    return &it->gaps;
+}
@@ -0,0 +1,29 @@
+#ifndef QDOMCOMPATWHITESPACE_P_H
+#define QDOMCOMPATWHITESPACE_P_H
+
+#include "qtxmlcompat_global.h"
+
+#include "qdomdocumentcompat.h"
+
+// Whitespace-only runs dropped from elements that have only element children.
+// Each element keeps one string per gap, before its first child, between its
+// children and before its end tag, so save(-1) can write the input back.
+class QDomCompatWhitespaceStore
+{
+public:
+    static bool isWhitespace(const QString &text);
+
+    void insert(const QDomNode &element, const QVector<QString> &gaps);
+
+    // nullptr if the element has none, or its children changed since the parse.
+    const QVector<QString> *gaps(const QDomNode &element) const;
+
+private:
+    struct Entry {
+        QDomNode element;   // keeps the node data, and so its identity, alive
+        QVector<QString> gaps;
+    };
+    QHash<const void *, Entry> entries;
+};
+
+#endif // QDOMCOMPATWHITESPACE_P_H
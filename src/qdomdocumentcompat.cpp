@@ -1,12 +1,40 @@
 #include "qdomdocumentcompat.h"
 #include "qdomdocumentcompat_p.h"
-
+#include "qdomcompatasync_p.h"
+#include "qdomcompatdiff_p.h"
+#include "qdomcompatdigest_p.h"
+#include "qdomcompatfrozen_p.h"
+#include "qdomcompatgzip_p.h"
+#include "qdomcompatindex_p.h"
+#include "qdomcompatpath_p.h"
+#include "qdomcompatrecords_p.h"
+#include "qdomcompatsource_p.h"
+#include "qdomcompattext_p.h"
+#include "qdomcompatwhitespace_p.h"
+
+#include <QBuffer>
 #include <QDebug>
+#include <QRegularExpression>
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+#include <QStringConverter>
+#else
+#include <QTextCodec>
+#endif
+#include <QThreadPool>
+
+#include <algorithm>
 
 QDomDocumentCompat::QDomDocumentCompat()
     : QDomDocument()
     , handler(nullptr)
     , namespaceProcessing(false)
+    , compactThreshold(0)
+    , whitespace(KeepWhitespace)
+    , indexEnabled(false)
+    , idAttributeNames(QStringList() << QStringLiteral("id") << QStringLiteral("xml:id"))
+    , elementIndex(new QDomCompatElementIndex(idAttributeNames))
+    , progress(nullptr)
+    , outputCompression(NoCompression)
 {
 }
 
@@ -14,6 +42,13 @@ QDomDocumentCompat::QDomDocumentCompat(const QString &name)
     : QDomDocument(name)
     , handler(nullptr)
     , namespaceProcessing(false)
+    , compactThreshold(0)
+    , whitespace(KeepWhitespace)
+    , indexEnabled(false)
+    , idAttributeNames(QStringList() << QStringLiteral("id") << QStringLiteral("xml:id"))
+    , elementIndex(new QDomCompatElementIndex(idAttributeNames))
+    , progress(nullptr)
+    , outputCompression(NoCompression)
 {
 }
 
@@ -21,13 +56,30 @@ QDomDocumentCompat::QDomDocumentCompat(const QDomDocumentType &doctype)
     : QDomDocument(doctype)
     , handler(nullptr)
     , namespaceProcessing(false)
+    , compactThreshold(0)
+    , whitespace(KeepWhitespace)
+    , indexEnabled(false)
+    , idAttributeNames(QStringList() << QStringLiteral("id") << QStringLiteral("xml:id"))
+    , elementIndex(new QDomCompatElementIndex(idAttributeNames))
+    , progress(nullptr)
+    , outputCompression(NoCompression)
 {
 }
 
 QDomDocumentCompat::QDomDocumentCompat(const QDomDocumentCompat &x)
     : QDomDocument(x)
     , handler(nullptr)
-    , namespaceProcessing(false)
+    , namespaceProcessing(x.namespaceProcessing)
+    , compactThreshold(x.compactThreshold)
+    , textStore(x.textStore)
+    , whitespace(x.whitespace)
+    , whitespaceStore(x.whitespaceStore)
+    , indexEnabled(x.indexEnabled)
+    , idAttributeNames(x.idAttributeNames)
+    , elementIndex(x.elementIndex)
+    , progress(nullptr)
+    , limits(x.limits)
+    , outputCompression(x.outputCompression)
 {
 }
 
@@ -38,17 +90,34 @@ QDomDocumentCompat::~QDomDocumentCompat()
     }
 }
 
-bool QDomDocumentCompat::setContent(QXmlInputSource *source, QXmlReader *reader, QString *errorMsg, int *errorLine, int *errorColumn)
+QDomDocumentCompat &QDomDocumentCompat::operator=(const QDomDocumentCompat &x)
 {
-    clear();
-
-    namespaceProcessing = reader->feature(QLatin1String("http://xml.org/sax/features/namespaces"))
-        && !reader->feature(QLatin1String("http://xml.org/sax/features/namespace-prefixes"));
-
+    if(this == &x){
+        return *this;
+    }
+    QDomDocument::operator=(x);
+    //the handler belongs to the parse that created it, never share it
     if(handler != nullptr){
         delete handler;
+        handler = nullptr;
     }
-    handler = new QXmlSimpleHandler(this, namespaceProcessing);
+    namespaceProcessing = x.namespaceProcessing;
+    compactThreshold = x.compactThreshold;
+    textStore = x.textStore;
+    whitespace = x.whitespace;
+    whitespaceStore = x.whitespaceStore;
+    indexEnabled = x.indexEnabled;
+    idAttributeNames = x.idAttributeNames;
+    elementIndex = x.elementIndex;
+    limits = x.limits;
+    outputCompression = x.outputCompression;
+    return *this;
+}
+
+bool QDomDocumentCompat::setContent(QXmlInputSource *source, QXmlReader *reader, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    startParse(reader->feature(QLatin1String("http://xml.org/sax/features/namespaces"))
+               && !reader->feature(QLatin1String("http://xml.org/sax/features/namespace-prefixes")));
 
     reader->setContentHandler(handler);
     reader->setLexicalHandler(handler);
@@ -58,6 +127,7 @@ bool QDomDocumentCompat::setContent(QXmlInputSource *source, QXmlReader *reader,
 
     bool ok = reader->parse(source);
     if(!ok){
+        elementIndex->invalidate();
         if(errorMsg != nullptr){
             *errorMsg = handler->errorInfo().message;
         }
@@ -72,6 +142,50 @@ bool QDomDocumentCompat::setContent(QXmlInputSource *source, QXmlReader *reader,
     return ok;
 }
 
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+bool QDomDocumentCompat::setContent(QByteArrayView data, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    return parseBytes(data.data(), data.size(), namespaceProcessing, errorMsg, errorLine, errorColumn);
+}
+#else
+bool QDomDocumentCompat::setContent(const char *data, qsizetype size, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    return parseBytes(data, size, namespaceProcessing, errorMsg, errorLine, errorColumn);
+}
+#endif
+
+bool QDomDocumentCompat::setContent(QStringView text, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    QDomCompatViewSource source(text);
+    return parse(&source, namespaceProcessing, errorMsg, errorLine, errorColumn);
+}
+
+bool QDomDocumentCompat::setContent(QIODevice *device, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    QDomCompatGzipDevice gzip(device);
+    QIODevice *input = gzip.openForInput();
+    if(input == nullptr){
+        clear();
+        return compressionError(gzip, errorMsg, errorLine, errorColumn);
+    }
+
+    //QXmlInputSource reads and decodes the device a chunk at a time
+    QXmlInputSource source(input);
+    const bool ok = parse(&source, namespaceProcessing, errorMsg, errorLine, errorColumn);
+    if(gzip.hasError()){
+        if(ok){
+            //a damaged trailer can follow a complete document
+            clear();
+            return compressionError(gzip, errorMsg, errorLine, errorColumn);
+        }
+        //the reader only saw the input end early
+        if(errorMsg != nullptr){
+            *errorMsg = gzip.errorString();
+        }
+    }
+    return ok;
+}
+
 void QDomDocumentCompat::save(QTextStream &s, int indent, QDomNode::EncodingPolicy encodingPolicy) const
 {
     Q_UNUSED(encodingPolicy)
@@ -79,6 +193,76 @@ void QDomDocumentCompat::save(QTextStream &s, int indent, QDomNode::EncodingPoli
     save(s, *this, 0, indent);
 }
 
+bool QDomDocumentCompat::save(QIODevice *device, int indent, QString *errorMsg) const
+{
+    //checked first, so an unsupported encoding writes nothing
+    QTextStream probe;
+    if(!setDeclaredEncoding(probe, errorMsg)){
+        return false;
+    }
+
+    QDomCompatGzipDevice gzip(device);
+    QIODevice *output = device;
+    if(outputCompression == GzipCompression){
+        if(!gzip.open(QIODevice::WriteOnly)){
+            if(errorMsg != nullptr){
+                *errorMsg = gzip.errorString();
+            }
+            return false;
+        }
+        output = &gzip;
+    }
+
+    bool ok;
+    {
+        //the stream buffer is the only copy of the text, compressed a chunk at a time
+        QTextStream s(output);
+        setDeclaredEncoding(s, nullptr);
+        save(s, *this, 0, indent);
+        s.flush();
+        ok = s.status() == QTextStream::Ok;
+    }
+    if(ok && output == &gzip){
+        ok = gzip.finish();
+    }
+    if(!ok && errorMsg != nullptr){
+        *errorMsg = output->errorString().isEmpty() ? QStringLiteral("Write error") : output->errorString();
+    }
+    return ok;
+}
+
+//Sets the encoding named by the XML declaration as QDomNode::EncodingFromDocument does, UTF-8 without one.
+bool QDomDocumentCompat::setDeclaredEncoding(QTextStream &s, QString *errorMsg) const
+{
+    QByteArray name("UTF-8");
+    const QDomNode first = firstChild();
+    if(first.isProcessingInstruction() && first.nodeName() == QLatin1String("xml")){
+        static const QRegularExpression encoding(QStringLiteral("encoding\\s*=\\s*(['\"])([^'\"]*)\\1"));
+        const QRegularExpressionMatch match = encoding.match(first.nodeValue());
+        if(match.hasMatch()){
+            name = match.captured(2).toLatin1();
+        }
+    }
+
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    const std::optional<QStringConverter::Encoding> converter = QStringConverter::encodingForName(name.constData());
+    if(converter){
+        s.setEncoding(*converter);
+        return true;
+    }
+#else
+    QTextCodec *codec = QTextCodec::codecForName(name);
+    if(codec != nullptr){
+        s.setCodec(codec);
+        return true;
+    }
+#endif
+    if(errorMsg != nullptr){
+        *errorMsg = QStringLiteral("Unsupported encoding in the XML declaration: %1").arg(QString::fromLatin1(name));
+    }
+    return false;
+}
+
 QString QDomDocumentCompat::toString(int indent) const
 {
     QString str;
@@ -87,10 +271,332 @@ QString QDomDocumentCompat::toString(int indent) const
     return str;
 }
 
+QByteArray QDomDocumentCompat::digest(QCryptographicHash::Algorithm algorithm, DigestMode mode, int indent) const
+{
+    if(mode == CanonicalDigest){
+        QDomCompatDigester digester(algorithm);
+        digester.setTextStore(textStore.data());
+        return digester.digest(*this);
+    }
+
+    //feed the save() output through the stream buffer, without building the string
+    QCryptographicHash hash(algorithm);
+    QDomCompatHashDevice device(&hash);
+    device.open(QIODevice::WriteOnly);
+    {
+        QTextStream s(&device);
+#if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+        s.setCodec("UTF-8");
+#endif
+        save(s, *this, 0, indent);
+        s.flush();
+    }
+    return hash.result();
+}
+
+QVector<QDomCompatSubtreeDigest> QDomDocumentCompat::subtreeDigests(QCryptographicHash::Algorithm algorithm) const
+{
+    QVector<QDomCompatSubtreeDigest> list;
+    QDomCompatDigester digester(algorithm);
+    digester.setTextStore(textStore.data());
+    digester.digest(*this, &list);
+    return list;
+}
+
+QVector<QDomCompatDifference> QDomDocumentCompat::diff(const QDomDocument &other, DiffOptions options) const
+{
+    return QDomCompatDiffer(options, textStore.data(), nullptr).diff(*this, other);
+}
+
+QVector<QDomCompatDifference> QDomDocumentCompat::diff(const QDomDocumentCompat &other, DiffOptions options) const
+{
+    return QDomCompatDiffer(options, textStore.data(), other.textStore.data()).diff(*this, other);
+}
+
+void QDomDocumentCompat::setCompactTextThreshold(int length)
+{
+    compactThreshold = qMax(0, length);
+}
+
+int QDomDocumentCompat::compactTextThreshold() const
+{
+    return compactThreshold;
+}
+
+QString QDomDocumentCompat::textValue(const QDomNode &node) const
+{
+    if(textStore.isNull()){
+        return node.nodeValue();
+    }
+    return textStore->text(node);
+}
+
+void QDomDocumentCompat::expandCompactText()
+{
+    if(!textStore.isNull()){
+        textStore->expand();
+    }
+}
+
+void QDomDocumentCompat::pruneCompactText()
+{
+    if(!textStore.isNull()){
+        textStore->prune();
+    }
+}
+
+void QDomDocumentCompat::setWhitespacePolicy(WhitespacePolicy policy)
+{
+    whitespace = policy;
+}
+
+QDomDocumentCompat::WhitespacePolicy QDomDocumentCompat::whitespacePolicy() const
+{
+    return whitespace;
+}
+
+void QDomDocumentCompat::setElementIndexEnabled(bool enable)
+{
+    indexEnabled = enable;
+}
 
-void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, int indent, const QHash<QString, QString> ns_hash) const
+bool QDomDocumentCompat::isElementIndexEnabled() const
+{
+    return indexEnabled;
+}
+
+void QDomDocumentCompat::setIdAttributes(const QStringList &qualifiedNames)
+{
+    idAttributeNames = qualifiedNames;
+    elementIndex.reset(new QDomCompatElementIndex(idAttributeNames));
+    elementIndex->invalidate();
+}
+
+QStringList QDomDocumentCompat::idAttributes() const
+{
+    return idAttributeNames;
+}
+
+QVector<QDomElement> QDomDocumentCompat::elementsByName(const QString &namespaceURI, const QString &localName) const
+{
+    return validIndex()->elements(namespaceURI, localName);
+}
+
+QDomElement QDomDocumentCompat::elementById(const QString &elementId) const
+{
+    return validIndex()->element(elementId);
+}
+
+void QDomDocumentCompat::invalidateIndex()
+{
+    elementIndex->invalidate();
+}
+
+QVector<QDomNode> QDomDocumentCompat::select(const QString &expression, const QHash<QString, QString> &namespaces) const
+{
+    const QDomCompatPath path(expression, namespaces);
+    if(path.plan.isNull()){
+        return QVector<QDomNode>();
+    }
+    return path.plan->evaluate(*this, textStore.data());
+}
+
+void QDomDocumentCompat::setParseLimits(const QDomCompatParseLimits &limits)
+{
+    this->limits = limits;
+}
+
+QDomCompatParseLimits QDomDocumentCompat::parseLimits() const
+{
+    return limits;
+}
+
+void QDomDocumentCompat::setCompression(Compression compression)
+{
+    outputCompression = compression;
+}
+
+QDomDocumentCompat::Compression QDomDocumentCompat::compression() const
+{
+    return outputCompression;
+}
+
+bool QDomDocumentCompat::isCompressionSupported()
+{
+    return QDomCompatGzipDevice::isSupported();
+}
+
+QFuture<QDomCompatParseResult> QDomDocumentCompat::setContentAsync(const QByteArray &data, bool namespaceProcessing, QThreadPool *pool) const
+{
+    return (new QDomCompatParseTask(*this, data, namespaceProcessing))->start(pool);
+}
+
+QFuture<QDomCompatSaveResult> QDomDocumentCompat::saveAsync(QIODevice *device, int indent, QThreadPool *pool) const
+{
+    return (new QDomCompatSaveTask(*this, device, indent))->start(pool);
+}
+
+bool QDomDocumentCompat::processRecords(QIODevice *device, const QString &recordName, const std::function<void(const QDomCompatRecord &)> &process,
+                                        const QDomCompatRecordOptions &options, QString *errorMsg, int *errorLine, int *errorColumn) const
+{
+    QThreadPool *pool = options.pool != nullptr ? options.pool : QThreadPool::globalInstance();
+    const int queueDepth = options.queueDepth > 0 ? options.queueDepth : 2 * pool->maxThreadCount();
+    QDomCompatRecordSplitter splitter(*this, recordName, options.namespaceProcessing, process, pool, queueDepth);
+
+    QDomCompatGzipDevice gzip(device);
+    QIODevice *input = gzip.openForInput();
+    if(input == nullptr){
+        return compressionError(gzip, errorMsg, errorLine, errorColumn);
+    }
+
+    //QXmlInputSource reads and decodes the device a chunk at a time
+    QXmlInputSource source(input);
+    QXmlSimpleReader reader;
+    reader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), options.namespaceProcessing);
+    reader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), !options.namespaceProcessing);
+    reader.setContentHandler(&splitter);
+    reader.setLexicalHandler(&splitter);
+    reader.setErrorHandler(&splitter);
+
+    const bool ok = reader.parse(&source);
+    splitter.finish();
+    if(ok && gzip.hasError()){
+        return compressionError(gzip, errorMsg, errorLine, errorColumn);
+    }
+    if(!ok){
+        if(errorMsg != nullptr){
+            *errorMsg = gzip.hasError() ? gzip.errorString() : splitter.errorInfo().message;
+        }
+        if(errorLine != nullptr){
+            *errorLine = splitter.errorInfo().lineNumber;
+        }
+        if(errorColumn != nullptr){
+            *errorColumn = splitter.errorInfo().columnNumber;
+        }
+    }
+    return ok;
+}
+
+QDomCompatFrozenDocument QDomDocumentCompat::freeze() const
+{
+    return QDomCompatFrozenBuilder(*this).build();
+}
+
+QDomCompatElementIndex *QDomDocumentCompat::validIndex() const
+{
+    elementIndex->ensureValid(*this);
+    return elementIndex.data();
+}
+
+bool QDomDocumentCompat::parseBytes(const char *data, qsizetype size, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    if(QDomCompatGzipDevice::isCompressed(data, size)){
+        //inflated a chunk at a time like a device, never as a whole
+        QByteArray bytes = QByteArray::fromRawData(data, int(size));
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly);
+        return setContent(&buffer, namespaceProcessing, errorMsg, errorLine, errorColumn);
+    }
+    if(QDomCompatViewSource::isUtf8(data, size)){
+        QDomCompatViewSource source(data, size);
+        return parse(&source, namespaceProcessing, errorMsg, errorLine, errorColumn);
+    }
+    //QXmlInputSource detects the encoding, the bytes themselves aren't copied
+    QXmlInputSource source;
+    source.setData(QByteArray::fromRawData(data, int(size)));
+    return parse(&source, namespaceProcessing, errorMsg, errorLine, errorColumn);
+}
+
+//Reports input with a compressed header that can't be inflated, at its start.
+bool QDomDocumentCompat::compressionError(const QDomCompatGzipDevice &gzip, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    if(errorMsg != nullptr){
+        *errorMsg = gzip.errorString();
+    }
+    if(errorLine != nullptr){
+        *errorLine = 0;
+    }
+    if(errorColumn != nullptr){
+        *errorColumn = 0;
+    }
+    return false;
+}
+
+bool QDomDocumentCompat::parse(QXmlInputSource *source, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn)
+{
+    QXmlSimpleReader reader;
+    reader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), namespaceProcessing);
+    reader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), !namespaceProcessing);
+    return setContent(source, &reader, errorMsg, errorLine, errorColumn);
+}
+
+
+//Clears the document and sets up a handler that builds the tree from reader events.
+QXmlSimpleHandler *QDomDocumentCompat::startParse(bool namespaceProcessing)
+{
+    clear();
+
+    this->namespaceProcessing = namespaceProcessing;
+
+    if(handler != nullptr){
+        delete handler;
+    }
+    handler = new QXmlSimpleHandler(this, namespaceProcessing);
+
+    //the previous tree may still be shared with copies, so start a new store
+    textStore.reset();
+    if(compactThreshold > 0){
+        textStore.reset(new QDomCompatTextStore());
+        handler->setTextStore(textStore.data(), compactThreshold);
+    }
+    whitespaceStore.reset();
+    if(whitespace == DropWhitespace){
+        whitespaceStore.reset(new QDomCompatWhitespaceStore());
+    }
+    handler->setWhitespacePolicy(whitespace, whitespaceStore.data());
+    handler->setProgress(progress);
+    handler->setLimits(limits);
+    elementIndex.reset(new QDomCompatElementIndex(idAttributeNames));
+    if(indexEnabled){
+        handler->setElementIndex(elementIndex.data());
+    }else{
+        elementIndex->invalidate();
+    }
+    return handler;
+}
+
+void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, int indent, const QHash<QString, QString> &ns_hash) const
+{
+    //pick the instantiation once, the walk itself has no layout or namespace checks left
+    if(indent == -1){
+        if(namespaceProcessing){
+            saveNode<QDomCompatSavePolicy<CompactSave, true> >(s, node, depth, indent, ns_hash);
+        }else{
+            saveNode<QDomCompatSavePolicy<CompactSave, false> >(s, node, depth, indent, ns_hash);
+        }
+    }else if(indent < 1){
+        if(namespaceProcessing){
+            saveNode<QDomCompatSavePolicy<NewlineSave, true> >(s, node, depth, indent, ns_hash);
+        }else{
+            saveNode<QDomCompatSavePolicy<NewlineSave, false> >(s, node, depth, indent, ns_hash);
+        }
+    }else{
+        if(namespaceProcessing){
+            saveNode<QDomCompatSavePolicy<IndentedSave, true> >(s, node, depth, indent, ns_hash);
+        }else{
+            saveNode<QDomCompatSavePolicy<IndentedSave, false> >(s, node, depth, indent, ns_hash);
+        }
+    }
+}
+
+template <typename Policy>
+void QDomDocumentCompat::saveNode(QTextStream &s, const QDomNode &node, int depth, int indent, const QHash<QString, QString> &ns_hash) const
 {
     //qDebug() << node.nodeType() << node.nodeName() << node.nodeValue();
+    if(progress != nullptr && !progress->step()){
+        //canceled, unwind without writing more
+        return;
+    }
     if(node.isAttr()){
         if(!node.namespaceURI().isEmpty()){
             if(node.parentNode().namespaceURI() == node.namespaceURI()){
@@ -105,22 +611,27 @@ void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, i
         }else{
             s << QLatin1Char(' ');
         }
-        s << node.localName() << QStringLiteral("=\"") << encodeAttributeValue(node.nodeValue()) << QStringLiteral("\"");
+        //Attributes created without namespace processing have no local name.
+        s << (node.localName().isNull() ? node.nodeName() : node.localName())
+          << QStringLiteral("=\"") << encodeAttributeValue(node.nodeValue()) << QStringLiteral("\"");
 
     }else if(node.isCDATASection()){
-        node.toCDATASection().save(s, indent);
+        if(textStore.isNull() || !textStore->save(s, node, indent)){
+            node.toCDATASection().save(s, indent);
+        }
 
     }else if(node.isComment()){
         node.toComment().save(s, indent);
 
     }else if(node.isDocument()){
+        //childNodes().at(i) rebuilds the node list on each call, so walk the siblings.
         bool first = true;
-        for(int i=0; i < node.childNodes().length(); i++){
-            if(first && !node.childNodes().at(i).isProcessingInstruction()){
-                save(s, node.toDocument().doctype(), 0, indent);
+        for(QDomNode child = node.firstChild(); !child.isNull(); child = child.nextSibling()){
+            if(first && !child.isProcessingInstruction()){
+                saveNode<Policy>(s, node.toDocument().doctype(), 0, indent);
                 first = false;
             }
-            save(s, node.childNodes().at(i), depth, indent);
+            saveNode<Policy>(s, child, depth, indent);
         }
 
     }else if(node.isDocumentFragment()){
@@ -152,7 +663,7 @@ void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, i
                 keys.sort();
 #endif
                 for(const QString &key: keys){
-                    save(s, node.toDocumentType().entities().namedItem(key), 0, indent);
+                    saveNode<Policy>(s, node.toDocumentType().entities().namedItem(key), 0, indent);
                 }
 
                 hash.clear();
@@ -165,7 +676,7 @@ void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, i
                 keys.sort();
 #endif
                 for(const QString &key: keys){
-                    save(s, node.toDocumentType().notations().namedItem(key), 0, indent);
+                    saveNode<Policy>(s, node.toDocumentType().notations().namedItem(key), 0, indent);
                 }
 
                 s << QLatin1Char(']');
@@ -174,71 +685,44 @@ void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, i
         }
 
     }else if(node.isElement()){
-        if(!node.previousSibling().isText()){
-            s << QString(indent < 1 ? 0 : depth*indent, QLatin1Char(' '));
-        }
-
-        //for avoid duplicate
-        QHash<QString, QString> tag_ns_hash;
-
-        //open
-        s << QLatin1Char('<') << node.nodeName();
-        if(!node.namespaceURI().isEmpty()){
-            s << QStringLiteral(" xmlns");
-            if(!node.prefix().isEmpty()){
-                s << QLatin1Char(':') << node.prefix();
-            }
-            s << QStringLiteral("=\"") << encodeAttributeValue(node.namespaceURI()) << QStringLiteral("\"");
-            //for avoid duplicate
-            tag_ns_hash[node.namespaceURI()] = node.prefix();
+        if(Policy::Indented && !node.previousSibling().isText()){
+            s << QString(depth*indent, QLatin1Char(' '));
         }
 
-        //attributes
-        if(node.hasAttributes()){
-            QStringList attr_names;
-            QHash<QString, QDomNode> attr_hash;
-            for(int i=0; i<node.attributes().count(); i++){
-                attr_hash[node.attributes().item(i).nodeName()] = node.attributes().item(i);
-            }
-            attr_names = attr_hash.keys();
-#ifdef QT_DEBUG
-            attr_names.sort();
-#endif
-            for(const QString &attr_name: attr_names){
-                if(namespaceProcessing && !attr_hash[attr_name].namespaceURI().isEmpty()){
-                    save(s, node.attributes().namedItemNS(attr_hash[attr_name].namespaceURI(), attr_hash[attr_name].localName()), 0, indent, tag_ns_hash);
-                    tag_ns_hash[attr_hash[attr_name].namespaceURI()] = attr_hash[attr_name].prefix();
-                }else{
-                    save(s, node.attributes().namedItem(attr_hash[attr_name].localName()), 0, indent, tag_ns_hash);
-                }
-            }
-        }
+        saveStartTag<Policy>(s, node, indent);
 
         //children and close
         if(!node.hasChildNodes()){
             s << QStringLiteral("/>");
         }else{
             s << QLatin1Char('>');
-            if(!node.childNodes().at(0).isText()){
-                if(indent != -1){
-                    s << Qt::endl;
+            if(Policy::Newlines && !node.firstChild().isText()){
+                s << Qt::endl;
+            }
+            //children, with the whitespace dropped by the parse around them
+            const QVector<QString> *gaps = nullptr;
+            if(Policy::Layout == CompactSave && !whitespaceStore.isNull()){
+                gaps = whitespaceStore->gaps(node);
+            }
+            int gap = 0;
+            for(QDomNode child = node.firstChild(); !child.isNull(); child = child.nextSibling()){
+                if(gaps != nullptr){
+                    s << gaps->at(gap++);
                 }
+                saveNode<Policy>(s, child, depth + 1, indent);
             }
-            //children
-            for(int i=0; i < node.childNodes().length(); i++){
-                save(s, node.childNodes().at(i), depth + 1, indent);
+            if(gaps != nullptr){
+                s << gaps->at(gap);
             }
             //close
-            if(!node.childNodes().at(node.childNodes().length()-1).isText()){
-                s << QString(indent < 1 ? 0 : depth*indent, QLatin1Char(' '));
+            if(Policy::Indented && !node.lastChild().isText()){
+                s << QString(depth*indent, QLatin1Char(' '));
             }
             s << QStringLiteral("</") << node.nodeName() << QLatin1Char('>');
         }
 
-        if(!node.nextSibling().isText()){
-            if(indent != -1){
-                s << Qt::endl;
-            }
+        if(Policy::Newlines && !node.nextSibling().isText()){
+            s << Qt::endl;
         }
 
     }else if(node.isEntity()){
@@ -256,13 +740,82 @@ void QDomDocumentCompat::save(QTextStream &s, const QDomNode &node, int depth, i
         node.toProcessingInstruction().save(s, indent);
 
     }else if(node.isText()){
-        node.toText().save(s, indent);
+        if(textStore.isNull() || !textStore->save(s, node, indent)){
+            node.toText().save(s, indent);
+        }
 
     }else {
         //qDebug() << QStringLiteral("unknown") << node.nodeType();
     }
 }
 
+//From '<' through the attributes, the rest of the element depends on the layout.
+template <typename Policy>
+void QDomDocumentCompat::saveStartTag(QTextStream &s, const QDomNode &node, int indent) const
+{
+    //for avoid duplicate
+    QHash<QString, QString> tag_ns_hash;
+
+    //open
+    s << QLatin1Char('<') << node.nodeName();
+    if(!node.namespaceURI().isEmpty()){
+        s << QStringLiteral(" xmlns");
+        if(!node.prefix().isEmpty()){
+            s << QLatin1Char(':') << node.prefix();
+        }
+        s << QStringLiteral("=\"") << encodeAttributeValue(node.namespaceURI()) << QStringLiteral("\"");
+        //for avoid duplicate
+        tag_ns_hash[node.namespaceURI()] = node.prefix();
+    }
+
+    //attributes
+    if(node.hasAttributes()){
+        const QDomNamedNodeMap attrs = node.attributes();
+        const int attr_count = attrs.count();
+#ifdef QT_DEBUG
+        //sorted by name, so that debug output compares stably
+        QVector<QDomNode> sorted;
+        sorted.reserve(attr_count);
+        for(int i=0; i<attr_count; i++){
+            sorted.append(attrs.item(i));
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const QDomNode &a, const QDomNode &b){
+            return a.nodeName() < b.nodeName();
+        });
+#endif
+        //One walk over the map, looking the nodes up again by namespace would scan it.
+        for(int i=0; i<attr_count; i++){
+#ifdef QT_DEBUG
+            const QDomNode attr = sorted.at(i);
+#else
+            const QDomNode attr = attrs.item(i);
+#endif
+            const QString attr_name = attr.nodeName();
+            const QString attr_uri = attr.namespaceURI();
+            if(Policy::NamespaceProcessing && !attr_uri.isEmpty()){
+                saveNode<Policy>(s, attr, 0, indent, tag_ns_hash);
+                tag_ns_hash[attr_uri] = attr.prefix();
+            }else if(attr.localName().isNull() || attr.localName() == attr_name){
+                saveNode<Policy>(s, attr, 0, indent, tag_ns_hash);
+            }else{
+                saveNode<Policy>(s, attrs.namedItem(attr.localName()), 0, indent, tag_ns_hash);
+            }
+        }
+    }
+}
+
+QString QDomDocumentCompat::startTag(const QDomNode &element) const
+{
+    QString str;
+    QTextStream s(&str, QIODevice::WriteOnly);
+    if(namespaceProcessing){
+        saveStartTag<QDomCompatSavePolicy<CompactSave, true> >(s, element, -1);
+    }else{
+        saveStartTag<QDomCompatSavePolicy<CompactSave, false> >(s, element, -1);
+    }
+    return str;
+}
+
 QString QDomDocumentCompat::encodeAttributeValue(const QString &text) const
 {
     QString ret;
@@ -303,6 +856,15 @@ QXmlSimpleHandler::QXmlSimpleHandler(QDomDocument *doc, bool namespaceProcessing
     , document(doc)
     , namespaceProcessing(namespaceProcessing)
     , in_cdata(false)
+    , textStore(nullptr)
+    , compactThreshold(0)
+    , elementIndex(nullptr)
+    , progress(nullptr)
+    , whitespace(QDomDocumentCompat::KeepWhitespace)
+    , whitespaceStore(nullptr)
+    , nodeCount(0)
+    , estimatedBytes(0)
+    , depth(0)
 {
     Q_ASSERT(doc);
 }
@@ -321,6 +883,7 @@ bool QXmlSimpleHandler::startDocument()
 bool QXmlSimpleHandler::endDocument()
 {
 //    qDebug() << "endDocument";
+    templates.clear();
     return currentNode.isDocument();
 }
 
@@ -339,22 +902,23 @@ bool QXmlSimpleHandler::endPrefixMapping(const QString &prefix)
 bool QXmlSimpleHandler::startElement(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts)
 {
     //qDebug() << "startElement" << namespaceURI << localName << qName;
-    QDomElement element;
-
-    if(namespaceProcessing){
-        element = document->createElementNS(namespaceURI, qName);
-    }else{
-        element = document->createElement(qName);
+    if(!proceed()){
+        return false;
     }
-
+    if(limits.depth > 0 && depth >= limits.depth){
+        return exceeded(QStringLiteral("depth"), limits.depth);
+    }
+    if(limits.attributes > 0 && atts.length() > limits.attributes){
+        return exceeded(QStringLiteral("attribute count"), limits.attributes);
+    }
+    qint64 bytes = NodeCost + qName.size() * qint64(sizeof(QChar));
     for(int i=0; i<atts.length(); i++){
-        //qDebug() << atts.uri(i) << atts.qName(i) << atts.value(i);
-        if(namespaceProcessing){
-            element.setAttributeNS(atts.uri(i), atts.qName(i), atts.value(i));
-        }else{
-            element.setAttribute(atts.qName(i), atts.value(i));
-        }
+        bytes += NodeCost + (atts.qName(i).size() + atts.value(i).size()) * qint64(sizeof(QChar));
+    }
+    if(!reserve(1 + atts.length(), bytes)){
+        return false;
     }
+    QDomElement element = createElement(namespaceURI, qName, atts);
 
     if(currentNode.isNull()){
         document->appendChild(element);
@@ -363,6 +927,21 @@ bool QXmlSimpleHandler::startElement(const QString &namespaceURI, const QString
     }
 
     currentNode = element;
+    depth++;
+    if(whitespace == QDomDocumentCompat::DropWhitespace){
+        if(!frames.isEmpty()){
+            frames.last().children++;
+        }
+        frames.append(WhitespaceFrame());
+    }
+
+    if(elementIndex != nullptr){
+        if(namespaceProcessing){
+            elementIndex->add(namespaceURI, localName, element, atts);
+        }else{
+            elementIndex->add(QString(), qName, element, atts);
+        }
+    }
 
     return true;
 }
@@ -379,7 +958,13 @@ bool QXmlSimpleHandler::endElement(const QString &namespaceURI, const QString &l
                 .arg(qName);
         return false;
     }else{
+        if(!frames.isEmpty()){
+            if(!endWhitespaceFrame()){
+                return false;
+            }
+        }
         currentNode = currentNode.parentNode();
+        depth--;
         return true;
     }
 }
@@ -387,6 +972,37 @@ bool QXmlSimpleHandler::endElement(const QString &namespaceURI, const QString &l
 bool QXmlSimpleHandler::characters(const QString &ch)
 {
     //qDebug() << "characters" << ch;
+    if(!proceed()){
+        return false;
+    }
+    if(limits.textLength > 0 && ch.length() > limits.textLength){
+        return exceeded(QStringLiteral("text length"), limits.textLength);
+    }
+    if(whitespace != QDomDocumentCompat::KeepWhitespace && !in_cdata && QDomCompatWhitespaceStore::isWhitespace(ch)){
+        return whitespaceCharacters(ch);
+    }
+    if(!keepWhitespace()){
+        return false;
+    }
+    //compacted text is held as at most one byte per character
+    const bool compact = textStore != nullptr && ch.length() >= compactThreshold;
+    if(!reserve(1, NodeCost + ch.size() * qint64(compact ? 1 : sizeof(QChar)))){
+        return false;
+    }
+    if(compact){
+        //the data goes to the store as bytes, the node holds the store's empty marker
+        QDomNode node;
+        if(in_cdata){
+            node = document->createCDATASection(QString());
+        }else{
+            node = document->createTextNode(QString());
+        }
+        if(!textStore->insert(node, ch)){
+            node.setNodeValue(ch);
+        }
+        currentNode.appendChild(node);
+        return true;
+    }
     if(in_cdata){
         QDomCDATASection cdata = document->createCDATASection(ch);
         currentNode.appendChild(cdata);
@@ -405,6 +1021,15 @@ bool QXmlSimpleHandler::ignorableWhitespace(const QString &ch)
 bool QXmlSimpleHandler::processingInstruction(const QString &target, const QString &data)
 {
     //qDebug() << "processingInstruction" << target << data;
+    if(!proceed()){
+        return false;
+    }
+    if(!reserve(1, NodeCost + (target.size() + data.size()) * qint64(sizeof(QChar)))){
+        return false;
+    }
+    if(!keepWhitespace()){
+        return false;
+    }
     QDomNode n = document->createProcessingInstruction(target, data);
     if(currentNode.isNull()){
         document->appendChild(n);
@@ -417,6 +1042,15 @@ bool QXmlSimpleHandler::processingInstruction(const QString &target, const QStri
 bool QXmlSimpleHandler::skippedEntity(const QString &name)
 {
     //qDebug() << "skippedEntity" << name;
+    if(!proceed()){
+        return false;
+    }
+    if(!reserve(1, NodeCost + name.size() * qint64(sizeof(QChar)))){
+        return false;
+    }
+    if(!keepWhitespace()){
+        return false;
+    }
     currentNode.appendChild(document->createEntityReference(name));
     return true;
 }
@@ -432,8 +1066,9 @@ bool QXmlSimpleHandler::startDTD(const QString &name, const QString &publicId, c
     QDomImplementation impl;
     QDomDocumentType type = impl.createDocumentType(name, publicId, systemId);
     QDomDocument doc(type);
-    for(int i=0; i<document->childNodes().length(); i++){
-        doc.appendChild(document->childNodes().at(i).cloneNode(true));
+    //Only the prolog exists at this point, but don't rebuild the child list per node.
+    for(QDomNode child = document->firstChild(); !child.isNull(); child = child.nextSibling()){
+        doc.appendChild(child.cloneNode(true));
     }
     *document = doc;
     return true;
@@ -475,6 +1110,18 @@ bool QXmlSimpleHandler::endCDATA()
 bool QXmlSimpleHandler::comment(const QString &ch)
 {
     //qDebug() << "comment" << ch;
+    if(!proceed()){
+        return false;
+    }
+    if(limits.textLength > 0 && ch.length() > limits.textLength){
+        return exceeded(QStringLiteral("text length"), limits.textLength);
+    }
+    if(!reserve(1, NodeCost + ch.size() * qint64(sizeof(QChar)))){
+        return false;
+    }
+    if(!keepWhitespace()){
+        return false;
+    }
     currentNode.appendChild(document->createComment(ch));
     return true;
 }
@@ -535,5 +1182,183 @@ const ErrorInfo &QXmlSimpleHandler::errorInfo() const
     return m_errorInfo;
 }
 
+void QXmlSimpleHandler::setTextStore(QDomCompatTextStore *store, int threshold)
+{
+    textStore = store;
+    compactThreshold = threshold;
+}
+
+void QXmlSimpleHandler::setElementIndex(QDomCompatElementIndex *index)
+{
+    elementIndex = index;
+}
+
+void QXmlSimpleHandler::setProgress(QDomCompatProgress *progress)
+{
+    this->progress = progress;
+}
+
+void QXmlSimpleHandler::setWhitespacePolicy(QDomDocumentCompat::WhitespacePolicy policy, QDomCompatWhitespaceStore *store)
+{
+    whitespace = policy;
+    whitespaceStore = store;
+}
+
+void QXmlSimpleHandler::setLimits(const QDomCompatParseLimits &limits)
+{
+    this->limits = limits;
+}
+
+bool QXmlSimpleHandler::reserve(qint64 nodes, qint64 bytes)
+{
+    nodeCount += nodes;
+    estimatedBytes += bytes;
+    if(limits.nodes > 0 && nodeCount > limits.nodes){
+        return exceeded(QStringLiteral("node count"), limits.nodes);
+    }
+    if(limits.estimatedBytes > 0 && estimatedBytes > limits.estimatedBytes){
+        return exceeded(QStringLiteral("estimated size"), limits.estimatedBytes);
+    }
+    return true;
+}
+
+bool QXmlSimpleHandler::exceeded(const QString &name, qint64 limit)
+{
+    m_errorString = QStringLiteral("Limit exceeded: %1 (%2)").arg(name).arg(limit);
+    return false;
+}
+
+QDomElement QXmlSimpleHandler::createElement(const QString &namespaceURI, const QString &qName, const QXmlAttributes &atts)
+{
+    //setAttributeNS() scans the attributes already set, so elements with many of them
+    //are cloned from the first element with the same names and only get their values.
+    //setAttribute() finds them by name, nothing to gain without namespace processing.
+    QString key;
+    if(namespaceProcessing && atts.length() >= TemplateAttributes){
+        key = namespaceURI + QChar(0) + qName;
+        for(int i=0; i<atts.length(); i++){
+            key += QChar(0) + atts.uri(i) + QChar(1) + atts.qName(i);
+        }
+        QHash<QString, QDomElement>::const_iterator it = templates.constFind(key);
+        if(it != templates.constEnd()){
+            QDomElement element = it->cloneNode(false).toElement();
+            const QDomNamedNodeMap attrs = element.attributes();
+            for(int i=0; i<atts.length(); i++){
+                //the map is keyed by the qualified name
+                attrs.namedItem(atts.qName(i)).setNodeValue(atts.value(i));
+            }
+            return element;
+        }
+    }
+
+    QDomElement element;
+
+    if(namespaceProcessing){
+        element = document->createElementNS(namespaceURI, qName);
+    }else{
+        element = document->createElement(qName);
+    }
+
+    for(int i=0; i<atts.length(); i++){
+        //qDebug() << atts.uri(i) << atts.qName(i) << atts.value(i);
+        if(namespaceProcessing){
+            element.setAttributeNS(atts.uri(i), atts.qName(i), atts.value(i));
+        }else{
+            element.setAttribute(atts.qName(i), atts.value(i));
+        }
+    }
+
+    //two prefixes of the same URI with the same local name replace each other, don't use those
+    if(!key.isEmpty() && templates.size() < TemplateLimit && element.attributes().count() == atts.length()){
+        templates.insert(key, element.cloneNode(false).toElement());
+    }
+    return element;
+}
+
+bool QXmlSimpleHandler::whitespaceCharacters(const QString &ch)
+{
+    //identical runs, mostly indentation, share one string
+    QSet<QString>::const_iterator it = whitespaceStrings.constFind(ch);
+    if(it == whitespaceStrings.constEnd()){
+        it = whitespaceStrings.insert(ch);
+    }
+    const QString text = *it;
+
+    if(frames.isEmpty() || frames.last().mixed){
+        if(!reserve(1, NodeCost)){
+            return false;
+        }
+        currentNode.appendChild(document->createTextNode(text));
+        if(!frames.isEmpty()){
+            frames.last().children++;
+        }
+        return true;
+    }
+
+    //put aside until the element turns out to have other content than elements
+    WhitespaceFrame &frame = frames.last();
+    if(!frame.pending.isEmpty() && frame.pending.last().index == frame.children){
+        frame.pending.last().text += text;
+    }else{
+        PendingWhitespace pending;
+        pending.previous = currentNode.lastChild();
+        pending.index = frame.children;
+        pending.text = text;
+        frame.pending.append(pending);
+    }
+    return true;
+}
+
+bool QXmlSimpleHandler::keepWhitespace()
+{
+    if(frames.isEmpty() || frames.last().mixed){
+        return true;
+    }
+    WhitespaceFrame &frame = frames.last();
+    frame.mixed = true;
+    if(!reserve(frame.pending.size(), NodeCost * frame.pending.size())){
+        return false;
+    }
+    for(const PendingWhitespace &pending: frame.pending){
+        QDomText text = document->createTextNode(pending.text);
+        if(pending.previous.isNull()){
+            currentNode.insertBefore(text, currentNode.firstChild());
+        }else{
+            currentNode.insertAfter(text, pending.previous);
+        }
+    }
+    frame.pending.clear();
+    return true;
+}
+
+bool QXmlSimpleHandler::endWhitespaceFrame()
+{
+    //an element with nothing but whitespace keeps it, "<a> </a>" isn't "<a/>"
+    if(frames.last().children == 0){
+        if(!keepWhitespace()){
+            return false;
+        }
+    }
+    const WhitespaceFrame &frame = frames.last();
+    if(!frame.mixed && !frame.pending.isEmpty()){
+        QVector<QString> gaps(frame.children + 1);
+        for(const PendingWhitespace &pending: frame.pending){
+            gaps[pending.index] = pending.text;
+        }
+        whitespaceStore->insert(currentNode, gaps);
+    }
+    frames.removeLast();
+    return true;
+}
+
+bool QXmlSimpleHandler::proceed()
+{
+    if(progress != nullptr && !progress->step()){
+        m_errorString = QStringLiteral("Canceled");
+        return false;
+    }
+    return true;
+}
+
 
 
@@ -2,9 +2,16 @@
 #define QDOMDOCUMENTCOMPAT_H
 
 #include "qtxmlcompat_global.h"
+#include "qdomcompatfrozen.h"
+#include "qdomcompatpath.h"
 
+#include <QCryptographicHash>
+#include <QFuture>
+#include <functional>
 #include <QHash>
+#include <QSharedPointer>
 #include <QTextStream>
+#include <QVector>
 #include <QtXml/QDomDocument>
 #if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
 #include <QtXml/QXmlSimpleReader>
@@ -15,6 +22,63 @@
 #endif
 
 class QXmlSimpleHandler;
+class QDomCompatTextStore;
+class QDomCompatElementIndex;
+class QDomCompatWhitespaceStore;
+class QDomCompatProgress;
+class QDomCompatGzipDevice;
+class QThreadPool;
+struct QDomCompatParseResult;
+struct QDomCompatSaveResult;
+struct QDomCompatRecord;
+
+struct QDomCompatSubtreeDigest {
+    QDomNode node;
+    int depth;
+    QByteArray digest;
+};
+
+struct QDomCompatDifference {
+    enum Type {
+        Inserted,
+        Removed,
+        Moved,
+        Changed,
+        AttributeInserted,
+        AttributeRemoved,
+        AttributeChanged
+    };
+
+    Type type;
+    QString oldPath;        // empty for Inserted
+    QString newPath;        // empty for Removed
+    QDomNode oldNode;       // owner element for attribute changes
+    QDomNode newNode;
+    QString attributeName;
+    QString oldValue;       // attribute or character data value
+    QString newValue;
+};
+
+// Limits checked while setContent() builds the tree, 0 means unlimited.
+// estimatedBytes is an approximation of the memory held by the nodes and their strings.
+struct QDomCompatParseLimits {
+    qint64 estimatedBytes;
+    qint64 nodes;           // elements, attributes, text, comments, ...
+    int depth;              // element nesting
+    int attributes;         // per element
+    qint64 textLength;      // characters per text or CDATA run, and per comment
+
+    QDomCompatParseLimits() : estimatedBytes(0), nodes(0), depth(0), attributes(0), textLength(0) {}
+};
+
+// Options of QDomDocumentCompat::processRecords().
+struct QDomCompatRecordOptions {
+    bool namespaceProcessing;
+    int queueDepth;         // records parsed but not processed yet, 0 for twice the pool's thread count
+    QThreadPool *pool;      // the global pool when null
+
+    QDomCompatRecordOptions() : namespaceProcessing(true), queueDepth(0), pool(nullptr) {}
+};
 
 class QTXMLCOMPAT_EXPORT QDomDocumentCompat : public QDomDocument
 {
@@ -24,18 +88,181 @@ public:
     explicit QDomDocumentCompat(const QDomDocumentType& doctype);
     QDomDocumentCompat(const QDomDocumentCompat& x);
     ~QDomDocumentCompat();
+    QDomDocumentCompat &operator=(const QDomDocumentCompat &x);
 
     using QDomDocument::setContent;
     bool setContent(QXmlInputSource *source, QXmlReader *reader, QString *errorMsg=nullptr, int *errorLine=nullptr, int *errorColumn=nullptr );
+    // Parse straight from the caller's buffer with a QXmlSimpleReader, no UTF-16 copy is made.
+    // Bytes are decoded as UTF-8 while reading, unless a byte order mark or the XML declaration
+    // names another encoding, those are decoded into a copy first. A device is read in chunks.
+    // A QByteArray or QString argument still picks the QDomDocument overloads. The QIODevice
+    // overload hides QDomDocument's: whitespace-only text is kept and errors are reported by
+    // QXmlSimpleReader, call QDomDocument::setContent() explicitly for the previous behavior.
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    bool setContent(QByteArrayView data, bool namespaceProcessing, QString *errorMsg=nullptr, int *errorLine=nullptr, int *errorColumn=nullptr);
+#else
+    bool setContent(const char *data, qsizetype size, bool namespaceProcessing, QString *errorMsg=nullptr, int *errorLine=nullptr, int *errorColumn=nullptr);
+#endif
+    bool setContent(QStringView text, bool namespaceProcessing, QString *errorMsg=nullptr, int *errorLine=nullptr, int *errorColumn=nullptr);
+    bool setContent(QIODevice *device, bool namespaceProcessing, QString *errorMsg=nullptr, int *errorLine=nullptr, int *errorColumn=nullptr);
     void save(QTextStream &s, int indent, EncodingPolicy encodingPolicy = QDomNode::EncodingFromDocument) const;
     QString toString(int indent = 1) const;
+    // Writes the document in the encoding named by its XML declaration, UTF-8 without one,
+    // compressed as set by setCompression(). Fails when that encoding isn't supported.
+    bool save(QIODevice *device, int indent, QString *errorMsg=nullptr) const;
+
+    // setContent() from a device or bytes, setContentAsync() and processRecords() inflate input
+    // that starts with a gzip or zlib header while they parse it. save(QIODevice *) and saveAsync()
+    // deflate their output to gzip with GzipCompression. Both run a chunk at a time.
+    // Compressed data needs the library built with zlib, see isCompressionSupported().
+    enum Compression {
+        NoCompression,      // default
+        GzipCompression
+    };
+    void setCompression(Compression compression);
+    Compression compression() const;
+    static bool isCompressionSupported();
+
+    enum DigestMode {
+        SerializedDigest,   // hash of the save() output encoded as UTF-8
+        CanonicalDigest     // bottom-up hash of names, sorted attributes and content, independent of prefixes and layout
+    };
+    QByteArray digest(QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256, DigestMode mode = SerializedDigest, int indent = -1) const;
+    QVector<QDomCompatSubtreeDigest> subtreeDigests(QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256) const;
+
+    enum DiffOption {
+        DiffDefault = 0x0,
+        DiffIgnoreWhitespaceText = 0x1
+    };
+    Q_DECLARE_FLAGS(DiffOptions, DiffOption)
+    QVector<QDomCompatDifference> diff(const QDomDocument &other, DiffOptions options = DiffDefault) const;
+    QVector<QDomCompatDifference> diff(const QDomDocumentCompat &other, DiffOptions options = DiffDefault) const;
+
+    // Text and CDATA nodes of at least `length` characters parsed by setContent() keep their
+    // data as Latin-1 or UTF-8 bytes. 0 disables it (default). This mode is compat-API-only:
+    // the data is seen by textValue(), save(), toString(), select(), digest() and diff(),
+    // while plain QDom calls (nodeValue(), QDomElement::text(), toString(),
+    // cloneNode(), importNode(), normalize()) see an empty value. Call expandCompactText()
+    // before handing the tree to such code. A value set on the node, an empty one too, wins
+    // over the stored data. Removed nodes keep their data until pruneCompactText(),
+    // expandCompactText() or the next setContent().
+    void setCompactTextThreshold(int length);
+    int compactTextThreshold() const;
+    QString textValue(const QDomNode &node) const;
+    void expandCompactText();
+    void pruneCompactText();
+
+    // Text runs of only spaces, tabs and newlines. Dropped runs come back from save() with
+    // indent -1 as long as the element's children aren't changed, other indents regenerate them.
+    enum WhitespacePolicy {
+        KeepWhitespace,     // one text node per run (default)
+        ShareWhitespace,    // one text node per run, identical runs share their string
+        DropWhitespace      // no text nodes within elements that have only element children
+    };
+    void setWhitespacePolicy(WhitespacePolicy policy);
+    WhitespacePolicy whitespacePolicy() const;
+
+    // Elements by namespace URI and local name (empty URI and the qualified name without
+    // namespace processing) and by id-like attributes. The index is built by setContent()
+    // when enabled, otherwise on the first lookup. Call invalidateIndex() after editing the tree.
+    // Copies share the index like they share the tree; lookups may run on several threads at
+    // once, editing, invalidateIndex() and setContent() may not.
+    void setElementIndexEnabled(bool enable);
+    bool isElementIndexEnabled() const;
+    void setIdAttributes(const QStringList &qualifiedNames);
+    QStringList idAttributes() const;
+    QVector<QDomElement> elementsByName(const QString &namespaceURI, const QString &localName) const;
+    QDomElement elementById(const QString &elementId) const;
+    void invalidateIndex();
+
+    // Evaluates a QDomCompatPath from the document node.
+    QVector<QDomNode> select(const QString &expression, const QHash<QString, QString> &namespaces = QHash<QString, QString>()) const;
+
+    // setContent() stops at the first exceeded limit and names it in errorMsg.
+    void setParseLimits(const QDomCompatParseLimits &limits);
+    QDomCompatParseLimits parseLimits() const;
+
+    // Run on `pool` (the global pool by default) and report progress in bytes read or nodes
+    // written. Canceling the future stops them at the next node; a canceled future has no result.
+    // setContentAsync() parses into a new document with the option values of this one, taken
+    // when it is called. saveAsync() walks this document's tree on the pool thread: don't modify
+    // the document or any copy of it, or use the device, until the future has finished.
+    QFuture<QDomCompatParseResult> setContentAsync(const QByteArray &data, bool namespaceProcessing = true, QThreadPool *pool = nullptr) const;
+    QFuture<QDomCompatSaveResult> saveAsync(QIODevice *device, int indent, QThreadPool *pool = nullptr) const;
+
+    // Streams `device` and cuts it at each element named `recordName` (the qualified name as
+    // written) outside another record. Each record is parsed into its own document with the
+    // options of this one, but always with KeepWhitespace, and handed to `process` on the pool.
+    // The parse waits while queueDepth records are pending, so memory stays flat. Content
+    // outside the records is only checked. Returns once the records are processed, false on a
+    // parse error after the ones before it. Don't call it from a thread of the pool.
+    bool processRecords(QIODevice *device, const QString &recordName, const std::function<void(const QDomCompatRecord &)> &process,
+                        const QDomCompatRecordOptions &options = QDomCompatRecordOptions(),
+                        QString *errorMsg=nullptr, int *errorLine=nullptr, int *errorColumn=nullptr) const;
+
+    // Read-only copy of the tree for concurrent readers, see QDomCompatFrozenDocument.
+    QDomCompatFrozenDocument freeze() const;
 
 private:
+    friend class QDomCompatParseTask;
+    friend class QDomCompatSaveTask;
+    friend class QDomCompatFrozenBuilder;
+    friend class QDomCompatRecordSplitter;
+
     QXmlSimpleHandler *handler;
     bool namespaceProcessing;
+    int compactThreshold;
+    QSharedPointer<QDomCompatTextStore> textStore;
+    WhitespacePolicy whitespace;
+    QSharedPointer<QDomCompatWhitespaceStore> whitespaceStore;
+    bool indexEnabled;
+    QStringList idAttributeNames;
+    QSharedPointer<QDomCompatElementIndex> elementIndex;
+    QDomCompatProgress *progress;
+    QDomCompatParseLimits limits;
+    Compression outputCompression;
 
-    void save(QTextStream &s, const QDomNode &node, int depth, int indent, const QHash<QString, QString> ns_hash = QHash<QString, QString>()) const;
+    QDomCompatElementIndex *validIndex() const;
+    QXmlSimpleHandler *startParse(bool namespaceProcessing);
+    bool parseBytes(const char *data, qsizetype size, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn);
+    bool parse(QXmlInputSource *source, bool namespaceProcessing, QString *errorMsg, int *errorLine, int *errorColumn);
+    static bool compressionError(const QDomCompatGzipDevice &gzip, QString *errorMsg, int *errorLine, int *errorColumn);
+    bool setDeclaredEncoding(QTextStream &s, QString *errorMsg) const;
+
+    void save(QTextStream &s, const QDomNode &node, int depth, int indent, const QHash<QString, QString> &ns_hash = QHash<QString, QString>()) const;
+    template <typename Policy>
+    void saveNode(QTextStream &s, const QDomNode &node, int depth, int indent, const QHash<QString, QString> &ns_hash = QHash<QString, QString>()) const;
+    template <typename Policy>
+    void saveStartTag(QTextStream &s, const QDomNode &node, int indent) const;
+    QString startTag(const QDomNode &element) const;
     QString encodeAttributeValue(const QString &text) const;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(QDomDocumentCompat::DiffOptions)
+
+struct QDomCompatParseResult {
+    bool ok;
+    QDomDocumentCompat document;    // null unless ok
+    QString errorMsg;
+    int errorLine;
+    int errorColumn;
+
+    QDomCompatParseResult() : ok(false), errorLine(0), errorColumn(0) {}
+};
+
+struct QDomCompatSaveResult {
+    bool ok;
+    QString errorString;
+
+    QDomCompatSaveResult() : ok(false) {}
+};
+
+struct QDomCompatRecord {
+    qint64 index;                           // 0 for the first record of the input
+    QDomDocumentCompat document;            // the record element is the document element
+    QHash<QString, QString> namespaces;     // prefix to URI in scope at the record, "" for the default
+
+    QDomCompatRecord() : index(0) {}
+};
+
 #endif // QDOMDOCUMENTCOMPAT_H
@@ -5,14 +5,35 @@
 
 
 #include "qdomdocumentcompat.h"
+#include <QSet>
 #include <QXmlDefaultHandler>
 
+class QDomCompatTextStore;
+class QDomCompatElementIndex;
+class QDomCompatProgress;
+class QDomCompatWhitespaceStore;
+
 struct ErrorInfo{
     QString message;
     int lineNumber;
     int columnNumber;
 };
 
+// Layout and namespace handling of save(), fixed per instantiation of saveNode().
+enum QDomCompatSaveLayout {
+    CompactSave,        // indent -1, nothing added
+    NewlineSave,        // indent 0, line breaks only
+    IndentedSave        // indent > 0
+};
+
+template <QDomCompatSaveLayout L, bool N>
+struct QDomCompatSavePolicy {
+    static const QDomCompatSaveLayout Layout = L;
+    static const bool Newlines = L != CompactSave;
+    static const bool Indented = L == IndentedSave;
+    static const bool NamespaceProcessing = N;
+};
+
 class QXmlSimpleHandler : public QXmlDefaultHandler
 {
 public:
@@ -57,14 +78,58 @@ public:
 
     //other
     const ErrorInfo &errorInfo() const;
+    void setTextStore(QDomCompatTextStore *store, int threshold);
+    void setElementIndex(QDomCompatElementIndex *index);
+    void setProgress(QDomCompatProgress *progress);
+    void setWhitespacePolicy(QDomDocumentCompat::WhitespacePolicy policy, QDomCompatWhitespaceStore *store);
+    void setLimits(const QDomCompatParseLimits &limits);
 private:
+    //rough size of a node in QDom, added to the size of its strings
+    enum { NodeCost = 96 };
+    //elements with at least TemplateAttributes attributes are cloned from a template
+    enum { TemplateAttributes = 8, TemplateLimit = 256 };
+
+    struct PendingWhitespace {
+        QDomNode previous;      // null before the first child
+        int index;
+        QString text;
+    };
+    struct WhitespaceFrame {
+        int children;
+        bool mixed;             // has text, CDATA, comments, ... so whitespace stays in the tree
+        QVector<PendingWhitespace> pending;
+
+        WhitespaceFrame() : children(0), mixed(false) {}
+    };
+
     QDomDocument *document;
     bool namespaceProcessing;
     QDomNode currentNode;
     bool in_cdata;
+    QDomCompatTextStore *textStore;
+    int compactThreshold;
+    QDomCompatElementIndex *elementIndex;
+    QDomCompatProgress *progress;
+    QDomDocumentCompat::WhitespacePolicy whitespace;
+    QDomCompatWhitespaceStore *whitespaceStore;
+    QSet<QString> whitespaceStrings;
+    QVector<WhitespaceFrame> frames;
+    QHash<QString, QDomElement> templates;   // by element and attribute names
+    QDomCompatParseLimits limits;
+    qint64 nodeCount;
+    qint64 estimatedBytes;
+    int depth;
 
     ErrorInfo m_errorInfo;
     QString m_errorString;
+
+    bool proceed();
+    QDomElement createElement(const QString &namespaceURI, const QString &qName, const QXmlAttributes &atts);
+    bool whitespaceCharacters(const QString &ch);
+    bool keepWhitespace();
+    bool endWhitespaceFrame();
+    bool reserve(qint64 nodes, qint64 bytes);
+    bool exceeded(const QString &name, qint64 limit);
 };
 
 #endif // QDOMDOCUMENTCOMPAT_P_H
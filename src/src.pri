@@ -2,13 +2,44 @@ QT += xml
 greaterThan(QT_MAJOR_VERSION, 5) {
 QT += core5compat
 }
+# Compressed input and output with the system zlib when pkg-config finds it,
+# CONFIG+=no_zlib leaves it out
+!no_zlib:packagesExist(zlib) {
+CONFIG += link_pkgconfig
+PKGCONFIG += zlib
+DEFINES += QTXMLCOMPAT_ZLIB
+}
 INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
 SOURCES += \
+    $$PWD/qdomcompatasync.cpp \
+    $$PWD/qdomcompatdiff.cpp \
+    $$PWD/qdomcompatdigest.cpp \
+    $$PWD/qdomcompatfrozen.cpp \
+    $$PWD/qdomcompatgzip.cpp \
+    $$PWD/qdomcompatindex.cpp \
+    $$PWD/qdomcompatpath.cpp \
+    $$PWD/qdomcompatrecords.cpp \
+    $$PWD/qdomcompatsource.cpp \
+    $$PWD/qdomcompattext.cpp \
+    $$PWD/qdomcompatwhitespace.cpp \
     $$PWD/qdomdocumentcompat.cpp
 
 HEADERS += \
+    $$PWD/qdomcompatasync_p.h \
+    $$PWD/qdomcompatdiff_p.h \
+    $$PWD/qdomcompatdigest_p.h \
+    $$PWD/qdomcompatfrozen.h \
+    $$PWD/qdomcompatfrozen_p.h \
+    $$PWD/qdomcompatgzip_p.h \
+    $$PWD/qdomcompatindex_p.h \
+    $$PWD/qdomcompatpath.h \
+    $$PWD/qdomcompatpath_p.h \
+    $$PWD/qdomcompatrecords_p.h \
+    $$PWD/qdomcompatsource_p.h \
+    $$PWD/qdomcompattext_p.h \
+    $$PWD/qdomcompatwhitespace_p.h \
     $$PWD/qdomdocumentcompat.h \
     $$PWD/qdomdocumentcompat_p.h \
     $$PWD/qtxmlcompat_global.h
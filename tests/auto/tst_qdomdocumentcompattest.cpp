@@ -1,4 +1,8 @@
+#include <QBuffer>
 #include <QDomImplementation>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
 #include <QtTest>
 
 #include "qdomdocumentcompat.h"
@@ -16,6 +20,15 @@ struct TestInfo {
     int indent;
 };
 
+class BlockingTask : public QRunnable
+{
+public:
+    explicit BlockingTask(QSemaphore *semaphore) : semaphore(semaphore) {}
+    void run() override { semaphore->acquire(); }
+private:
+    QSemaphore *semaphore;
+};
+
 class QDomDocumentCompatTest : public QObject
 {
     Q_OBJECT
@@ -32,7 +45,24 @@ private slots:
     void test_simpleReader();
     void test_from_file();
     void test_save();
-
+    void test_namespaceProcessingOff();
+    void test_digest();
+    void test_diff();
+    void test_compactText();
+    void test_elementIndex();
+    void test_path();
+    void test_async();
+    void test_parseLimits();
+    void test_whitespacePolicy();
+    void test_manyAttributes();
+    void test_setContentView();
+    void test_setContentDevice();
+    void test_freeze();
+    void test_processRecords();
+    void test_compression();
+    void test_saveEncoding();
+
+    bool setContentUseSimpleReader(QDomDocumentCompat &doc, const QString &xml) const;
     QString toStringUseSimpleReader(const QString &xml, const int indent) const;
     QString toString(const QString &xml, const int indent) const;
     QString loadFile(const QString &path);
@@ -298,6 +328,894 @@ void QDomDocumentCompatTest::test_save()
 
 }
 
+void QDomDocumentCompatTest::test_namespaceProcessingOff()
+{
+    QXmlInputSource xmlsource;
+    QXmlSimpleReader xmlreader;
+    xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), false);
+    xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), true);
+
+    QDomDocumentCompat doc;
+    xmlsource.setData(QStringLiteral("<p id=\"hoge\" xmlns:x=\"urn:x\" x:a=\"1\"> <br/>abc</p>"));
+    QVERIFY(doc.setContent(&xmlsource, &xmlreader));
+
+    //This test is failed on release build. (attribute order)
+    QString left = doc.toString(-1);
+    QString right = QStringLiteral("<p id=\"hoge\" x:a=\"1\" xmlns:x=\"urn:x\"> <br/>abc</p>");
+    if(left != right){
+        qDebug().noquote().nospace() << "//---- left ---\n" << left << "\n";
+        qDebug().noquote().nospace() << "//---- right ---\n" << right << "\n";
+    }
+    QVERIFY(left == right);
+}
+
+void QDomDocumentCompatTest::test_digest()
+{
+    QDomDocumentCompat doc;
+    QVERIFY(setContentUseSimpleReader(doc, loadFile(":/xml/act/document.xml")));
+
+    //serialized
+    for(int indent = -1; indent <= 2; indent++){
+        QByteArray left = doc.digest(QCryptographicHash::Sha256, QDomDocumentCompat::SerializedDigest, indent);
+        QByteArray right = QCryptographicHash::hash(doc.toString(indent).toUtf8(), QCryptographicHash::Sha256);
+        QVERIFY2(left == right, QString::number(indent).toUtf8());
+    }
+
+    //canonical
+    QDomDocumentCompat doc1;
+    QDomDocumentCompat doc2;
+    QDomDocumentCompat doc3;
+    QVERIFY(setContentUseSimpleReader(doc1, QStringLiteral("<a:root xmlns:a=\"urn:x\" b=\"2\" c=\"1\"><a:item id=\"1\">text</a:item><a:item id=\"1\">text</a:item></a:root>")));
+    QVERIFY(setContentUseSimpleReader(doc2, QStringLiteral("<x:root xmlns:x=\"urn:x\" c=\"1\" b=\"2\"><x:item id=\"1\"><![CDATA[text]]></x:item><x:item id=\"1\">text</x:item></x:root>")));
+    QVERIFY(setContentUseSimpleReader(doc3, QStringLiteral("<a:root xmlns:a=\"urn:y\" b=\"2\" c=\"1\"><a:item id=\"1\">text</a:item><a:item id=\"1\">text</a:item></a:root>")));
+    QVERIFY(doc1.digest(QCryptographicHash::Sha256, QDomDocumentCompat::SerializedDigest) != doc2.digest(QCryptographicHash::Sha256, QDomDocumentCompat::SerializedDigest));
+    QVERIFY(doc1.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest) == doc2.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+    QVERIFY(doc1.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest) != doc3.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+
+    //without namespace processing the prefixes are resolved from the xmlns attributes
+    QDomDocumentCompat plain1;
+    QDomDocumentCompat plain2;
+    QDomDocumentCompat plain3;
+    QVERIFY(plain1.setContent(QStringView(QStringLiteral("<a:root xmlns:a=\"urn:x\" b=\"2\" c=\"1\"><a:item id=\"1\" a:k=\"v\">text</a:item><a:item id=\"1\">text</a:item></a:root>")), false));
+    QVERIFY(plain2.setContent(QStringView(QStringLiteral("<x:root xmlns:x=\"urn:x\" c=\"1\" b=\"2\"><item xmlns=\"urn:x\" x:k=\"v\" id=\"1\">text</item><x:item id=\"1\">text</x:item></x:root>")), false));
+    QVERIFY(plain3.setContent(QStringView(QStringLiteral("<a:root xmlns:a=\"urn:y\" b=\"2\" c=\"1\"><a:item id=\"1\" a:k=\"v\">text</a:item><a:item id=\"1\">text</a:item></a:root>")), false));
+    const QByteArray canonical = plain1.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest);
+    QVERIFY(canonical == plain2.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+    QVERIFY(canonical != plain3.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+    QDomDocumentCompat namespaced;
+    QVERIFY(setContentUseSimpleReader(namespaced, plain1.toString(-1)));
+    QVERIFY(canonical == namespaced.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+
+    //subtrees
+    QVector<QDomCompatSubtreeDigest> list = doc1.subtreeDigests(QCryptographicHash::Sha256);
+    QVERIFY(list.length() == 6);
+    QVERIFY(list.at(0).node.isDocument());
+    QVERIFY(list.at(0).digest == doc1.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+    QVERIFY(list.at(1).node == doc1.documentElement());
+    QVERIFY(list.at(1).depth == 1);
+    QVERIFY(list.at(2).node.nodeName() == "a:item");
+    QVERIFY(list.at(3).node.isText());
+    QVERIFY(list.at(3).depth == 3);
+    QVERIFY(list.at(2).digest == list.at(4).digest);
+    QVERIFY(list.at(3).digest == list.at(5).digest);
+    QVERIFY(list.at(1).digest != list.at(2).digest);
+}
+
+void QDomDocumentCompatTest::test_diff()
+{
+    QDomDocumentCompat doc1;
+    QDomDocumentCompat doc2;
+    QVector<QDomCompatDifference> list;
+
+    //identical
+    QVERIFY(setContentUseSimpleReader(doc1, loadFile(":/xml/act/document.xml")));
+    QVERIFY(setContentUseSimpleReader(doc2, loadFile(":/xml/act/document.xml")));
+    QVERIFY(doc1.diff(doc2).isEmpty());
+
+    //attributes and text
+    QVERIFY(setContentUseSimpleReader(doc1, QStringLiteral("<root><a id=\"1\" k=\"v\">x</a></root>")));
+    QVERIFY(setContentUseSimpleReader(doc2, QStringLiteral("<root><a id=\"2\" n=\"1\">y</a></root>")));
+    list = doc1.diff(doc2);
+    QVERIFY(list.length() == 4);
+    QVERIFY(list.at(0).type == QDomCompatDifference::AttributeChanged);
+    QVERIFY(list.at(0).newPath == "/root[1]/a[1]/@id");
+    QVERIFY(list.at(0).oldValue == "1");
+    QVERIFY(list.at(0).newValue == "2");
+    QVERIFY(list.at(1).type == QDomCompatDifference::AttributeRemoved);
+    QVERIFY(list.at(1).attributeName == "k");
+    QVERIFY(list.at(2).type == QDomCompatDifference::AttributeInserted);
+    QVERIFY(list.at(2).attributeName == "n");
+    QVERIFY(list.at(3).type == QDomCompatDifference::Changed);
+    QVERIFY(list.at(3).oldPath == "/root[1]/a[1]/text()[1]");
+    QVERIFY(list.at(3).oldValue == "x");
+    QVERIFY(list.at(3).newValue == "y");
+
+    //reorder and insert
+    QVERIFY(setContentUseSimpleReader(doc1, QStringLiteral("<root><a/><b/><c/></root>")));
+    QVERIFY(setContentUseSimpleReader(doc2, QStringLiteral("<root><c/><a/><b/><d/></root>")));
+    list = doc1.diff(doc2);
+    QVERIFY(list.length() == 2);
+    QVERIFY(list.at(0).type == QDomCompatDifference::Moved);
+    QVERIFY(list.at(0).oldNode.nodeName() == "c");
+    QVERIFY(list.at(1).type == QDomCompatDifference::Inserted);
+    QVERIFY(list.at(1).newPath == "/root[1]/d[1]");
+    QVERIFY(list.at(1).oldPath.isEmpty());
+
+    //move to another parent
+    QVERIFY(setContentUseSimpleReader(doc1, QStringLiteral("<root><p><x>1</x></p><q/></root>")));
+    QVERIFY(setContentUseSimpleReader(doc2, QStringLiteral("<root><p/><q><x>1</x></q></root>")));
+    list = doc1.diff(doc2);
+    QVERIFY(list.length() == 1);
+    QVERIFY(list.at(0).type == QDomCompatDifference::Moved);
+    QVERIFY(list.at(0).oldPath == "/root[1]/p[1]/x[1]");
+    QVERIFY(list.at(0).newPath == "/root[1]/q[1]/x[1]");
+
+    //whitespace
+    QVERIFY(setContentUseSimpleReader(doc1, QStringLiteral("<root>\n  <a/>\n</root>")));
+    QVERIFY(setContentUseSimpleReader(doc2, QStringLiteral("<root><a/></root>")));
+    list = doc1.diff(doc2);
+    QVERIFY(list.length() == 2);
+    QVERIFY(list.at(0).type == QDomCompatDifference::Removed);
+    QVERIFY(list.at(0).oldPath == "/root[1]/text()[1]");
+    QVERIFY(list.at(1).oldPath == "/root[1]/text()[2]");
+    QVERIFY(doc1.diff(doc2, QDomDocumentCompat::DiffIgnoreWhitespaceText).isEmpty());
+
+    //without namespace processing the prefixes are resolved like the digests do
+    QVERIFY(doc1.setContent(QStringView(u"<r xmlns:a=\"urn:x\"><a:item v=\"1\"/></r>"), false));
+    QVERIFY(doc2.setContent(QStringView(u"<r xmlns:b=\"urn:x\"><b:item v=\"2\"/></r>"), false));
+    list = doc1.diff(doc2);
+    QVERIFY(list.length() == 1);
+    QVERIFY(list.at(0).type == QDomCompatDifference::AttributeChanged);
+    QVERIFY(list.at(0).oldPath == "/r[1]/a:item[1]/@v");
+    QVERIFY(list.at(0).newPath == "/r[1]/b:item[1]/@v");
+    QVERIFY(doc2.setContent(QStringView(u"<r xmlns:b=\"urn:x\"><b:item v=\"1\"/></r>"), false));
+    QVERIFY(doc1.diff(doc2).isEmpty());
+}
+
+void QDomDocumentCompatTest::test_compactText()
+{
+    const QString blob = QString("QmFzZTY0IGJsb2I=").repeated(64);
+    const QString xml = QStringLiteral("<root>\n"
+                                       "  <a>%1</a>\n"
+                                       "  <b><![CDATA[%1<&]]></b>\n"
+                                       "  <c>%1 &lt;x&gt; &amp; ]]&gt; &#xd;</c>\n"
+                                       "  <d>%1 \u65e5\u672c\u8a9e</d>\n"
+                                       "  <e>\u65e5\u672c\u8a9e\u65e5\u672c\u8a9e\u65e5\u672c\u8a9e</e>\n"
+                                       "  <f>short</f>\n"
+                                       "</root>").arg(blob);
+
+    QDomDocumentCompat doc1;
+    QDomDocumentCompat doc2;
+    doc2.setCompactTextThreshold(8);
+    QVERIFY(doc2.compactTextThreshold() == 8);
+    QVERIFY(setContentUseSimpleReader(doc1, xml));
+    QVERIFY(setContentUseSimpleReader(doc2, xml));
+
+    QDomElement a = doc2.documentElement().firstChildElement("a");
+    QDomElement d = doc2.documentElement().firstChildElement("d");
+    QDomElement e = doc2.documentElement().firstChildElement("e");
+    QDomElement f = doc2.documentElement().firstChildElement("f");
+    //compat-API-only, plain QDom sees an empty value
+    QVERIFY(a.firstChild().nodeValue().isEmpty());
+    QVERIFY(doc2.textValue(a.firstChild()) == blob);
+    QVERIFY(doc2.textValue(d.firstChild()) == doc1.documentElement().firstChildElement("d").firstChild().nodeValue());
+    //UTF-16 is smaller here
+    QVERIFY(!e.firstChild().nodeValue().isEmpty());
+    QVERIFY(!f.firstChild().nodeValue().isEmpty());
+
+    for(int indent = -1; indent <= 2; indent++){
+        QString left = doc1.toString(indent);
+        QString right = doc2.toString(indent);
+        if(left != right){
+            qDebug().noquote().nospace() << "//---- left ---\n" << left << "\n";
+            qDebug().noquote().nospace() << "//---- right ---\n" << right << "\n";
+        }
+        QVERIFY2(left == right, QString::number(indent).toUtf8());
+    }
+    QVERIFY(doc1.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest) == doc2.digest(QCryptographicHash::Sha256, QDomDocumentCompat::CanonicalDigest));
+    QVERIFY(doc1.diff(doc2).isEmpty());
+    QVERIFY(doc2.select(QStringLiteral("/root[a='%1']").arg(blob)).size() == 1);
+
+    //a value set later wins, an empty one too
+    a.firstChild().setNodeValue("changed");
+    QVERIFY(doc2.textValue(a.firstChild()) == "changed");
+    d.firstChild().setNodeValue(QString());
+    QVERIFY(doc2.textValue(d.firstChild()).isEmpty());
+
+    //removed nodes are dropped from the store
+    QDomNode removed = doc2.documentElement().removeChild(doc2.documentElement().firstChildElement("b"));
+    QVERIFY(doc2.textValue(removed.firstChild()) == blob + "<&");
+    doc2.pruneCompactText();
+    QVERIFY(doc2.textValue(removed.firstChild()).isEmpty());
+
+    doc2.expandCompactText();
+    QVERIFY(a.firstChild().nodeValue() == "changed");
+    QVERIFY(doc2.documentElement().firstChildElement("c").firstChild().nodeValue() == doc1.documentElement().firstChildElement("c").firstChild().nodeValue());
+}
+
+void QDomDocumentCompatTest::test_elementIndex()
+{
+    const QString xml = QStringLiteral("<root xmlns:a=\"urn:a\">"
+                                       "<a:item id=\"1\"/><item xml:id=\"2\"/>"
+                                       "<a:item id=\"3\"><a:item id=\"4\"/></a:item>"
+                                       "<b id=\"1\"/>"
+                                       "</root>");
+
+    //built while parsing, and on the first lookup
+    for(int i=0; i<2; i++){
+        QDomDocumentCompat doc;
+        doc.setElementIndexEnabled(i == 0);
+        QVERIFY(setContentUseSimpleReader(doc, xml));
+
+        QVector<QDomElement> list = doc.elementsByName("urn:a", "item");
+        QVERIFY(list.length() == 3);
+        QVERIFY(list.at(0).attribute("id") == "1");
+        QVERIFY(list.at(1).attribute("id") == "3");
+        QVERIFY(list.at(2).attribute("id") == "4");
+        QVERIFY(doc.elementsByName("", "item").length() == 1);
+        QVERIFY(doc.elementsByName("", "root").length() == 1);
+        QVERIFY(doc.elementsByName("urn:b", "item").isEmpty());
+
+        QVERIFY(doc.elementById("1").nodeName() == "a:item");
+        QVERIFY(doc.elementById("2").nodeName() == "item");
+        QVERIFY(doc.elementById("4").parentNode().toElement().attribute("id") == "3");
+        QVERIFY(doc.elementById("5").isNull());
+
+        //edits need an explicit invalidation
+        QDomElement element = doc.createElementNS("urn:a", "a:item");
+        element.setAttribute("id", "5");
+        doc.documentElement().appendChild(element);
+        doc.elementById("4").parentNode().removeChild(doc.elementById("4"));
+        QVERIFY(doc.elementById("5").isNull());
+        doc.invalidateIndex();
+        QVERIFY(doc.elementById("5") == element);
+        QVERIFY(doc.elementById("4").isNull());
+        QVERIFY(doc.elementsByName("urn:a", "item").length() == 3);
+    }
+
+    //without namespace processing and other id attributes
+    QDomDocumentCompat doc;
+    doc.setElementIndexEnabled(true);
+    doc.setIdAttributes(QStringList() << "name");
+    QVERIFY(doc.idAttributes() == QStringList() << "name");
+    QXmlInputSource xmlsource;
+    QXmlSimpleReader xmlreader;
+    xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), false);
+    xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), true);
+    xmlsource.setData(QStringLiteral("<root xmlns:a=\"urn:a\"><a:item name=\"x\" id=\"1\"/></root>"));
+    QVERIFY(doc.setContent(&xmlsource, &xmlreader));
+    QVERIFY(doc.elementsByName("", "a:item").length() == 1);
+    QVERIFY(doc.elementById("x").nodeName() == "a:item");
+    QVERIFY(doc.elementById("1").isNull());
+
+    //a tree replaced by QDomDocument's own parse or clear() is indexed again
+    QVERIFY(doc.QDomDocument::setContent(QStringLiteral("<other><b name=\"y\"/></other>"), true));
+    QVERIFY(doc.elementsByName("", "a:item").isEmpty());
+    QVERIFY(doc.elementById("x").isNull());
+    QVERIFY(doc.elementById("y").nodeName() == "b");
+    QVERIFY(doc.elementsByName("", "other").length() == 1);
+    doc.clear();
+    QVERIFY(doc.elementById("y").isNull());
+    QVERIFY(doc.elementsByName("", "b").isEmpty());
+}
+
+void QDomDocumentCompatTest::test_path()
+{
+    QDomDocumentCompat doc;
+    QVERIFY(setContentUseSimpleReader(doc, QStringLiteral("<w:document xmlns:w=\"urn:w\">"
+                                                          "<w:body>"
+                                                          "<w:p w:rsidR=\"1\"><w:r><w:t>a</w:t></w:r></w:p>"
+                                                          "<w:p><w:r><w:t>b</w:t></w:r><w:r><w:t>c</w:t></w:r></w:p>"
+                                                          "<w:tbl><w:tr><w:tc><w:p w:rsidR=\"2\"><w:r><w:t>d</w:t></w:r></w:p></w:tc></w:tr></w:tbl>"
+                                                          "<w:p w:rsidR=\"3\"/>"
+                                                          "</w:body>"
+                                                          "</w:document>")));
+    QHash<QString, QString> ns;
+    ns["x"] = "urn:w";
+    QVector<QDomNode> list;
+
+    list = QDomCompatPath("/x:document/x:body/x:p[@x:rsidR]", ns).evaluate(doc);
+    QVERIFY(list.length() == 2);
+    QVERIFY(list.at(1).toElement().attributeNS("urn:w", "rsidR") == "3");
+
+    list = doc.select("//x:p", ns);
+    QVERIFY(list.length() == 4);
+    QVERIFY(list.at(2).toElement().attributeNS("urn:w", "rsidR") == "2");
+
+    list = doc.select("//x:p[@x:rsidR='2']//x:t", ns);
+    QVERIFY(list.length() == 1);
+    QVERIFY(list.at(0).toElement().text() == "d");
+
+    list = doc.select("/x:document/x:body/x:p[2]/x:r[last()]/x:t/text()", ns);
+    QVERIFY(list.length() == 1);
+    QVERIFY(list.at(0).isText());
+    QVERIFY(list.at(0).nodeValue() == "c");
+
+    QVERIFY(doc.select("//x:r[1]/x:t", ns).length() == 3);
+    QVERIFY(doc.select("//x:t/../..", ns).length() == 3);
+    QVERIFY(doc.select("/x:document/x:body/*[x:r]", ns).length() == 2);
+    QVERIFY(doc.select("//x:p[@x:rsidR!='1']", ns).length() == 2);
+    QVERIFY(doc.select("//x:r[x:t='c']/..", ns).at(0) == list.at(0).parentNode().parentNode().parentNode());
+
+    list = doc.select("//x:p/@x:rsidR", ns);
+    QVERIFY(list.length() == 3);
+    QVERIFY(list.at(0).isAttr());
+    QVERIFY(list.at(0).nodeValue() == "1");
+    QVERIFY(list.at(2).nodeValue() == "3");
+
+    //unbound prefixes are compared as written
+    QVERIFY(doc.select("//w:t").length() == 4);
+    QVERIFY(doc.select("//x:t").isEmpty());
+
+    //relative to a context node
+    QDomElement body = doc.documentElement().firstChildElement();
+    QVERIFY(QDomCompatPath("x:p/x:r", ns).evaluate(body).length() == 3);
+    QVERIFY(QDomCompatPath(".", ns).evaluate(body).at(0) == body);
+
+    //nested contexts are returned in document order
+    QDomDocumentCompat nested;
+    QVERIFY(setContentUseSimpleReader(nested, "<a><a><b>1</b></a><b>2</b></a>"));
+    list = nested.select("//a/b");
+    QVERIFY(list.length() == 2);
+    QVERIFY(list.at(0).toElement().text() == "1");
+    QVERIFY(list.at(1).toElement().text() == "2");
+
+    //errors
+    QDomCompatPath path("//x:p[x:r/x:t]", ns);
+    QVERIFY(!path.isValid());
+    QVERIFY(!path.errorString().isEmpty());
+    QVERIFY(path.evaluate(doc).isEmpty());
+    QVERIFY(!QDomCompatPath("//@id").isValid());
+    QVERIFY(!QDomCompatPath("@id/a").isValid());
+    QVERIFY(!QDomCompatPath("").isValid());
+    QVERIFY(!QDomCompatPath().isValid());
+
+    //cached plans
+    QDomCompatPath first("//x:p", ns);
+    QDomCompatPath second("//x:p", ns);
+    QVERIFY(first.expression() == second.expression());
+    QVERIFY(first.evaluate(doc) == second.evaluate(doc));
+    QDomCompatPath::clearCache();
+    QVERIFY(QDomCompatPath("//x:p", ns).evaluate(doc).length() == 4);
+}
+
+void QDomDocumentCompatTest::test_async()
+{
+    const QString xml = loadFile(":/xml/act/document.xml");
+    QDomDocumentCompat expected;
+    QVERIFY(setContentUseSimpleReader(expected, xml));
+
+    //parse
+    QDomDocumentCompat options;
+    options.setElementIndexEnabled(true);
+    QFuture<QDomCompatParseResult> parsed = options.setContentAsync(xml.toUtf8());
+    parsed.waitForFinished();
+    QVERIFY(!parsed.isCanceled());
+    QDomCompatParseResult result = parsed.result();
+    QVERIFY(result.ok);
+    QVERIFY(result.document.isElementIndexEnabled());
+    QVERIFY(result.document.toString(-1) == expected.toString(-1));
+    QVERIFY(parsed.progressValue() == xml.toUtf8().size());
+
+    parsed = options.setContentAsync("<root><a></root>");
+    parsed.waitForFinished();
+    QVERIFY(!parsed.result().ok);
+    QVERIFY(!parsed.result().errorMsg.isEmpty());
+    QVERIFY(parsed.result().document.isNull());
+
+    //save
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QFuture<QDomCompatSaveResult> saved = result.document.saveAsync(&buffer, -1);
+    saved.waitForFinished();
+    QVERIFY(saved.result().ok);
+    QVERIFY(buffer.data() == expected.toString(-1).toUtf8());
+    QVERIFY(saved.progressValue() == saved.progressMaximum());
+
+    //canceled before it runs
+    QThreadPool pool;
+    pool.setMaxThreadCount(1);
+    QSemaphore semaphore;
+    pool.start(new BlockingTask(&semaphore));
+    parsed = options.setContentAsync(xml.toUtf8(), true, &pool);
+    parsed.cancel();
+    semaphore.release();
+    parsed.waitForFinished();
+    QVERIFY(parsed.isCanceled());
+    QVERIFY(parsed.resultCount() == 0);
+}
+
+void QDomDocumentCompatTest::test_parseLimits()
+{
+    const QString xml = QStringLiteral("<a x=\"1\" y=\"2\"><b><c>text</c></b><!--note--><b/></a>");
+    QDomDocumentCompat doc;
+    QString errorMsg;
+
+    QDomCompatParseLimits limits;
+    limits.depth = 3;
+    limits.attributes = 2;
+    limits.nodes = 8;
+    limits.textLength = 4;
+    doc.setParseLimits(limits);
+    QVERIFY(setContentUseSimpleReader(doc, xml));
+    QVERIFY(doc.toString(-1) == xml);
+
+    struct {
+        QDomCompatParseLimits limits;
+        QString name;
+    } cases[5];
+    cases[0].limits.depth = 2;
+    cases[0].name = QStringLiteral("depth");
+    cases[1].limits.attributes = 1;
+    cases[1].name = QStringLiteral("attribute count");
+    cases[2].limits.nodes = 7;
+    cases[2].name = QStringLiteral("node count");
+    cases[3].limits.textLength = 3;
+    cases[3].name = QStringLiteral("text length");
+    cases[4].limits.estimatedBytes = 256;
+    cases[4].name = QStringLiteral("estimated size");
+    for(const auto &c: cases){
+        QXmlInputSource source;
+        QXmlSimpleReader reader;
+        source.setData(xml);
+        doc.setParseLimits(c.limits);
+        QVERIFY(!doc.setContent(&source, &reader, &errorMsg));
+        QVERIFY2(errorMsg.contains(c.name), errorMsg.toUtf8());
+    }
+}
+
+void QDomDocumentCompatTest::test_whitespacePolicy()
+{
+    const QString xml = QStringLiteral("<root>\n  <a x=\"1\">\n    <b/>\n  </a>\n  <c>text <d/> </c>\n"
+                                       "  <e>\n    <!--n-->\n    <f/>\n  </e>\n  <g> </g>\n</root>");
+    QDomDocumentCompat keep;
+    QVERIFY(setContentUseSimpleReader(keep, xml));
+
+    QDomDocumentCompat shared;
+    shared.setWhitespacePolicy(QDomDocumentCompat::ShareWhitespace);
+    QVERIFY(setContentUseSimpleReader(shared, xml));
+    QVERIFY(shared.toString(-1) == xml);
+    QVERIFY(shared.documentElement().firstChild().isText());
+
+    QDomDocumentCompat dropped;
+    dropped.setWhitespacePolicy(QDomDocumentCompat::DropWhitespace);
+    QVERIFY(setContentUseSimpleReader(dropped, xml));
+    QVERIFY(dropped.toString(-1) == xml);
+    QVERIFY(dropped.toString(-1) == keep.toString(-1));
+    QDomElement root = dropped.documentElement();
+    QVERIFY(root.firstChild().isElement());
+    QVERIFY(root.firstChildElement("a").firstChild().isElement());
+    QVERIFY(root.firstChildElement("c").firstChild().isText());
+    QVERIFY(root.firstChildElement("e").firstChild().isText());
+    QVERIFY(root.firstChildElement("e").lastChild().isText());
+    QVERIFY(root.firstChildElement("g").firstChild().isText());
+    QVERIFY(root.childNodes().count() == 4);
+    QVERIFY(keep.documentElement().childNodes().count() == 9);
+
+    //regenerated indentation
+    const QString indented = QStringLiteral("<root>\n  <a x=\"1\">\n    <b/>\n  </a>\n  <c>text <d/> </c>\n</root>");
+    QVERIFY(setContentUseSimpleReader(dropped, indented));
+    QVERIFY(dropped.toString(2) == indented + "\n");
+    QVERIFY(dropped.toString(-1) == indented);
+
+    //edited children fall back to the regenerated layout
+    dropped.documentElement().appendChild(dropped.createElement("h"));
+    QVERIFY(dropped.toString(-1) == "<root><a x=\"1\">\n    <b/>\n  </a><c>text <d/> </c><h/></root>");
+}
+
+void QDomDocumentCompatTest::test_manyAttributes()
+{
+    //same names on every item, cloned from the first one
+    QString xml = QStringLiteral("<root xmlns=\"urn:root\" xmlns:p=\"urn:p\">");
+    for(int j=0; j<3; j++){
+        xml += QStringLiteral("<item");
+        for(int i=0; i<20; i++){
+            xml += QStringLiteral(" %1a%2=\"v%3\"").arg(i % 2 == 0 ? QStringLiteral("p:") : QString()).arg(i).arg(j * 100 + i);
+        }
+        xml += QStringLiteral(">%1</item>").arg(j);
+    }
+    xml += QStringLiteral("</root>");
+
+    QDomDocumentCompat doc;
+    QVERIFY(setContentUseSimpleReader(doc, xml));
+    QDomElement item = doc.documentElement().firstChildElement("item");
+    for(int j=0; j<3; j++){
+        QVERIFY(item.attributes().count() == 20);
+        QVERIFY(item.text() == QString::number(j));
+        for(int i=0; i<20; i++){
+            const QString value = QStringLiteral("v%1").arg(j * 100 + i);
+            if(i % 2 == 0){
+                QVERIFY(item.attributeNS("urn:p", QStringLiteral("a%1").arg(i)) == value);
+                QVERIFY(item.attributeNode(QStringLiteral("p:a%1").arg(i)).prefix() == "p");
+            }else{
+                QVERIFY(item.attributeNS("", QStringLiteral("a%1").arg(i)) == value);
+            }
+        }
+        item = item.nextSiblingElement("item");
+    }
+
+    //the output parses back to the same output
+    const QString str = doc.toString(-1);
+    QDomDocumentCompat again;
+    QVERIFY(setContentUseSimpleReader(again, str));
+    QVERIFY(again.toString(-1) == str);
+}
+
+static bool setContentBytes(QDomDocumentCompat &doc, const QByteArray &data, QString *errorMsg = nullptr)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    return doc.setContent(QByteArrayView(data), true, errorMsg);
+#else
+    return doc.setContent(data.constData(), data.size(), true, errorMsg);
+#endif
+}
+
+void QDomDocumentCompatTest::test_setContentView()
+{
+    const QString xml = loadFile(":/xml/act/document.xml");
+    QDomDocumentCompat expected;
+    QVERIFY(setContentUseSimpleReader(expected, xml));
+
+    QDomDocumentCompat doc;
+    QVERIFY(doc.setContent(QStringView(xml), true));
+    QVERIFY(doc.toString(-1) == expected.toString(-1));
+
+    QVERIFY(setContentBytes(doc, xml.toUtf8()));
+    QVERIFY(doc.toString(-1) == expected.toString(-1));
+
+    QByteArray data = xml.toUtf8();
+    QBuffer buffer(&data);
+    QVERIFY(doc.setContent(&buffer, true));
+    QVERIFY(doc.toString(-1) == expected.toString(-1));
+
+    //multi-byte sequences, a character above U+FFFF and a byte order mark
+    const QString text = QString::fromUtf8("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80 ok");
+    QVERIFY(setContentBytes(doc, "\xef\xbb\xbf<a>" + text.toUtf8() + "</a>"));
+    QVERIFY(doc.documentElement().text() == text);
+    QVERIFY(setContentBytes(doc, "<a>\xff\xc3</a>"));
+    QVERIFY(doc.documentElement().text() == QString(2, QChar(QChar::ReplacementCharacter)));
+
+    //other encodings go through QXmlInputSource
+    QVERIFY(setContentBytes(doc, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><a>\xe9</a>"));
+    QVERIFY(doc.documentElement().text() == QString(QChar(0xe9)));
+
+    QString errorMsg;
+    QVERIFY(!setContentBytes(doc, "<a><b></a>", &errorMsg));
+    QVERIFY(!errorMsg.isEmpty());
+    QVERIFY(!doc.setContent(QStringView(u"<a><b></a>"), true));
+}
+
+//The device overload used to be QDomDocument's, the content must not change.
+void QDomDocumentCompatTest::test_setContentDevice()
+{
+    QFile oldFile(":/xml/act/document.xml");
+    QDomDocument oldDoc;
+    QVERIFY(oldDoc.setContent(&oldFile, true));
+
+    QFile newFile(":/xml/act/document.xml");
+    QDomDocumentCompat newDoc;
+    QVERIFY(newDoc.setContent(&newFile, true));
+    QVERIFY(newDoc.diff(oldDoc, QDomDocumentCompat::DiffIgnoreWhitespaceText).isEmpty());
+
+    //the layout is kept now, like the other compat overloads do
+    QDomDocumentCompat expected;
+    QVERIFY(setContentUseSimpleReader(expected, loadFile(":/xml/act/document.xml")));
+    QVERIFY(newDoc.toString(-1) == expected.toString(-1));
+
+    //both fail on the same input, with their own messages
+    QByteArray data("<a><b></a>");
+    QBuffer oldBuffer(&data);
+    QBuffer newBuffer(&data);
+    QString errorMsg;
+    QVERIFY(!oldDoc.setContent(&oldBuffer, true));
+    QVERIFY(!newDoc.setContent(&newBuffer, true, &errorMsg));
+    QVERIFY(!errorMsg.isEmpty());
+}
+
+void QDomDocumentCompatTest::test_freeze()
+{
+    const QList<int> indents = QList<int>() << -1 << 0 << 1 << 2;
+
+    //same output as the document at the time of the freeze
+    QDomDocumentCompat doc;
+    QVERIFY(setContentUseSimpleReader(doc, loadFile(":/xml/act/document.xml")));
+    QDomCompatFrozenDocument frozen = doc.freeze();
+    QVERIFY(!frozen.isNull());
+    for(int indent: indents){
+        QVERIFY2(frozen.toString(indent) == doc.toString(indent), QStringLiteral("indent %1").arg(indent).toUtf8());
+    }
+    const QString before = doc.toString(-1);
+    doc.documentElement().appendChild(doc.createElement("added"));
+    QVERIFY(frozen.toString(-1) == before);
+    QVERIFY(QDomDocumentCompat().freeze().isNull());
+
+    //compacted text is frozen with its value
+    const QString blob = QString("QmFzZTY0IGJsb2I=").repeated(16);
+    QDomDocumentCompat compact;
+    compact.setCompactTextThreshold(8);
+    QVERIFY(setContentUseSimpleReader(compact, QStringLiteral("<r><a>%1 &amp;</a><b><![CDATA[%1]]></b></r>").arg(blob)));
+    frozen = compact.freeze();
+    QVERIFY(frozen.documentElement().firstChild().text() == blob + " &");
+    QVERIFY(frozen.documentElement().lastChild().firstChild().nodeValue() == blob);
+    for(int indent: indents){
+        QVERIFY2(frozen.toString(indent) == compact.toString(indent), QStringLiteral("compact indent %1").arg(indent).toUtf8());
+    }
+
+    const QString xml = QStringLiteral("<?xml version=\"1.0\"?>\n<!DOCTYPE root>\n<!--c-->\n"
+                                       "<root xmlns:a=\"urn:a\">\n"
+                                       "  <a:item id=\"1\" a:x=\"y\">text<![CDATA[<cd>]]><b/></a:item>\n"
+                                       "  <!--n-->\n  <?pi data?>\n"
+                                       "  <item id=\"2\"><c/></item>\n"
+                                       "</root>");
+    for(int i=0; i<2; i++){
+        QDomDocumentCompat misc;
+        misc.setWhitespacePolicy(i == 0 ? QDomDocumentCompat::KeepWhitespace : QDomDocumentCompat::DropWhitespace);
+        QVERIFY(setContentUseSimpleReader(misc, xml));
+        frozen = misc.freeze();
+        for(int indent: indents){
+            QVERIFY2(frozen.toString(indent) == misc.toString(indent), QStringLiteral("%1 indent %2").arg(i).arg(indent).toUtf8());
+        }
+    }
+
+    //navigation
+    QDomCompatFrozenNode root = frozen.documentElement();
+    QVERIFY(root.nodeName() == QLatin1String("root"));
+    QVERIFY(root.parentNode() == frozen.documentNode());
+    QDomCompatFrozenNode item = root.firstChild();
+    while(!item.isNull() && !item.isElement()){
+        item = item.nextSibling();
+    }
+    QVERIFY(item.namespaceURI() == QLatin1String("urn:a"));
+    QVERIFY(item.localName() == QLatin1String("item"));
+    QVERIFY(item.prefix() == QLatin1String("a"));
+    QVERIFY(item.attributeCount() == 2);
+    QVERIFY(item.attribute(u"id") == QLatin1String("1"));
+    QVERIFY(item.attributeNodeNS(u"urn:a", u"x").nodeValue() == QLatin1String("y"));
+    QVERIFY(item.attributeNodeNS(u"urn:a", u"x").parentNode() == item);
+    QVERIFY(item.attribute(u"missing").isNull());
+    QVERIFY(item.text() == "text<cd>");
+    QVERIFY(item.firstChild().isText());
+    QVERIFY(item.firstChild().nextSibling().nodeType() == QDomNode::CDATASectionNode);
+    QVERIFY(item.lastChild().nodeName() == QLatin1String("b"));
+    QVERIFY(item.lastChild().previousSibling().isText());
+    QVERIFY(!item.lastChild().hasChildNodes());
+    QVERIFY(item.index() < item.lastChild().index());
+
+    //index
+    QVERIFY(frozen.elementsByName("urn:a", "item").length() == 1);
+    QVERIFY(frozen.elementsByName("", "item").length() == 1);
+    QVERIFY(frozen.elementById("1") == item);
+    QVERIFY(frozen.elementById("2").firstChild().nodeName() == QLatin1String("c"));
+    QVERIFY(frozen.elementById("3").isNull());
+
+    //same matches as the document
+    QDomDocumentCompat misc;
+    QVERIFY(setContentUseSimpleReader(misc, xml));
+    QHash<QString, QString> ns;
+    ns["x"] = "urn:a";
+    const QStringList expressions = QStringList() << "/root/x:item" << "//item/c/.." << "//*[@id]"
+                                                  << "//x:item/@*" << "//text()" << "/root/node()[last()]"
+                                                  << "//*[c]" << "//x:item[@x:x='y']/b" << "x:*";
+    for(const QString &expression: expressions){
+        const QVector<QDomNode> expected = misc.select(expression, ns);
+        const QVector<QDomCompatFrozenNode> actual = frozen.select(expression, ns);
+        QVERIFY2(actual.length() == expected.length(), expression.toUtf8());
+        for(int i=0; i<actual.length(); i++){
+            QVERIFY2(actual.at(i).nodeName() == expected.at(i).nodeName(), expression.toUtf8());
+            QVERIFY2(actual.at(i).nodeValue() == expected.at(i).nodeValue(), expression.toUtf8());
+        }
+    }
+    QVERIFY(QDomCompatPath("x:item/b", ns).evaluate(root).length() == 1);
+}
+
+void QDomDocumentCompatTest::test_processRecords()
+{
+    QString xml = QStringLiteral("<?xml version=\"1.0\"?>\n<root xmlns=\"urn:root\" xmlns:p=\"urn:p\">\n");
+    for(int i=0; i<50; i++){
+        xml += QStringLiteral("  <record p:id=\"%1\">\n    <p:name>n%1</p:name>\n    <record>nested</record>\n  </record>\n").arg(i);
+    }
+    xml += QStringLiteral("</root>");
+    QByteArray data = xml.toUtf8();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+    QDomCompatRecordOptions options;
+    options.pool = &pool;
+    options.queueDepth = 3;
+
+    QMutex mutex;
+    QMap<qint64, QDomCompatRecord> records;
+    auto collect = [&](const QDomCompatRecord &record){
+        QMutexLocker locker(&mutex);
+        records.insert(record.index, record);
+    };
+
+    //one document per record, nested elements of the same name stay inside
+    QDomDocumentCompat doc;
+    QBuffer buffer(&data);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    QVERIFY(doc.processRecords(&buffer, "record", collect, options));
+    QVERIFY(records.size() == 50);
+    QDomCompatRecord record = records.value(7);
+    QDomElement element = record.document.documentElement();
+    QVERIFY(element.namespaceURI() == "urn:root");
+    QVERIFY(element.localName() == "record");
+    QVERIFY(element.attributeNS("urn:p", "id") == "7");
+    QVERIFY(element.firstChild().isText());
+    QVERIFY(element.firstChildElement("record").text() == "nested");
+    QVERIFY(element.text().contains("n7"));
+    QVERIFY(record.namespaces.value("") == "urn:root");
+    QVERIFY(record.namespaces.value("p") == "urn:p");
+    QDomDocumentCompat again;
+    QVERIFY(setContentUseSimpleReader(again, record.document.toString(-1)));
+    QVERIFY(again.toString(-1) == record.document.toString(-1));
+
+    //without namespace processing the declarations are copied onto the record element
+    records.clear();
+    options.namespaceProcessing = false;
+    QVERIFY(buffer.seek(0));
+    QVERIFY(doc.processRecords(&buffer, "record", collect, options));
+    QVERIFY(records.size() == 50);
+    element = records.value(0).document.documentElement();
+    QVERIFY(element.attribute("xmlns") == "urn:root");
+    QVERIFY(element.attribute("xmlns:p") == "urn:p");
+    QVERIFY(element.attribute("p:id") == "0");
+    QVERIFY(setContentUseSimpleReader(again, records.value(0).document.toString(-1)));
+    QVERIFY(again.documentElement().attributeNS("urn:p", "id") == "0");
+    options.namespaceProcessing = true;
+
+    //records keep their whitespace whatever the document's policy
+    records.clear();
+    doc.setWhitespacePolicy(QDomDocumentCompat::DropWhitespace);
+    QVERIFY(buffer.seek(0));
+    QVERIFY(doc.processRecords(&buffer, "record", collect, options));
+    QVERIFY(records.size() == 50);
+    QVERIFY(records.value(7).document.documentElement().firstChild().isText());
+    for(int indent = -1; indent <= 1; indent++){
+        QVERIFY2(records.value(7).document.toString(indent) == record.document.toString(indent), QString::number(indent).toUtf8());
+    }
+    doc.setWhitespacePolicy(QDomDocumentCompat::KeepWhitespace);
+
+    //the records before an error are processed
+    records.clear();
+    QByteArray broken = data.left(data.indexOf("p:id=\"10\""));
+    QBuffer brokenBuffer(&broken);
+    QVERIFY(brokenBuffer.open(QIODevice::ReadOnly));
+    QString errorMsg;
+    QVERIFY(!doc.processRecords(&brokenBuffer, "record", collect, options, &errorMsg));
+    QVERIFY(!errorMsg.isEmpty());
+    QVERIFY(records.size() == 10);
+
+    //the options of the document apply to each record
+    records.clear();
+    QDomCompatParseLimits limits;
+    limits.nodes = 3;
+    doc.setParseLimits(limits);
+    QVERIFY(buffer.seek(0));
+    QVERIFY(!doc.processRecords(&buffer, "record", collect, options, &errorMsg));
+    QVERIFY2(errorMsg.startsWith("Limit exceeded"), errorMsg.toUtf8());
+    QVERIFY(records.isEmpty());
+}
+
+void QDomDocumentCompatTest::test_compression()
+{
+    if(!QDomDocumentCompat::isCompressionSupported()){
+        QSKIP("Built without zlib");
+    }
+
+    QString xml = QStringLiteral("<?xml version=\"1.0\"?>\n<root xmlns=\"urn:root\">\n");
+    for(int i=0; i<2000; i++){
+        xml += QStringLiteral("  <record id=\"r%1\">text %1</record>\n").arg(i);
+    }
+    xml += QStringLiteral("</root>");
+    QDomDocumentCompat doc;
+    QVERIFY(setContentUseSimpleReader(doc, xml));
+    const QString expected = doc.toString(-1);
+
+    //uncompressed by default
+    QBuffer plain;
+    QVERIFY(plain.open(QIODevice::WriteOnly));
+    QVERIFY(doc.save(&plain, -1));
+    QVERIFY(plain.data() == expected.toUtf8());
+
+    //gzip output, detected on input
+    doc.setCompression(QDomDocumentCompat::GzipCompression);
+    QBuffer compressed;
+    QVERIFY(compressed.open(QIODevice::WriteOnly));
+    QVERIFY(doc.save(&compressed, -1));
+    QByteArray data = compressed.data();
+    QVERIFY(data.startsWith("\x1f\x8b"));
+    QVERIFY(data.size() < plain.data().size() / 4);
+
+    QDomDocumentCompat again;
+    QBuffer input(&data);
+    QVERIFY(input.open(QIODevice::ReadOnly));
+    QVERIFY(again.setContent(&input, true));
+    QVERIFY(again.toString(-1) == expected);
+    QVERIFY(setContentBytes(again, data));
+    QVERIFY(again.toString(-1) == expected);
+
+    //async parse and save
+    QFuture<QDomCompatParseResult> parsed = doc.setContentAsync(data);
+    parsed.waitForFinished();
+    QVERIFY(parsed.result().ok);
+    QVERIFY(parsed.result().document.toString(-1) == expected);
+    QVERIFY(parsed.result().document.compression() == QDomDocumentCompat::GzipCompression);
+    QBuffer asyncOutput;
+    QVERIFY(asyncOutput.open(QIODevice::WriteOnly));
+    QFuture<QDomCompatSaveResult> saved = doc.saveAsync(&asyncOutput, -1);
+    saved.waitForFinished();
+    QVERIFY(saved.result().ok);
+    QVERIFY(setContentBytes(again, asyncOutput.data()));
+    QVERIFY(again.toString(-1) == expected);
+
+    //records
+    QAtomicInt count;
+    QVERIFY(input.seek(0));
+    QVERIFY(doc.processRecords(&input, "record", [&](const QDomCompatRecord &){ count.ref(); }));
+    QVERIFY(count.loadAcquire() == 2000);
+
+    //truncated data, or a wrong checksum after the whole document, fails with the reason
+    QString errorMsg;
+    QVERIFY(!setContentBytes(again, data.left(data.size() / 2), &errorMsg));
+    QVERIFY2(errorMsg.startsWith("Compressed data"), errorMsg.toUtf8());
+    QByteArray damaged = data;
+    damaged[damaged.size() - 8] = char(damaged.at(damaged.size() - 8) ^ 0x01);
+    QVERIFY(!setContentBytes(again, damaged, &errorMsg));
+    QVERIFY2(errorMsg.startsWith("Compressed data"), errorMsg.toUtf8());
+
+    //padding after the end isn't read as another member
+    QVERIFY(setContentBytes(again, data + QByteArray(512, '\0')));
+    QVERIFY(again.toString(-1) == expected);
+}
+
+void QDomDocumentCompatTest::test_saveEncoding()
+{
+    QDomDocumentCompat doc;
+    QString errorMsg;
+
+    //UTF-8 without a declaration
+    QVERIFY(doc.setContent(QStringView(u"<r>caf\u00e9</r>"), true));
+    QBuffer utf8;
+    QVERIFY(utf8.open(QIODevice::WriteOnly));
+    QVERIFY(doc.save(&utf8, -1));
+    QVERIFY(utf8.data() == "<r>caf\xc3\xa9</r>");
+
+    //the declared encoding, and the bytes read back as the same document
+    QVERIFY(doc.setContent(QStringView(u"<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><r>caf\u00e9</r>"), true));
+    const QString expected = doc.toString(-1);
+    QBuffer latin1;
+    QVERIFY(latin1.open(QIODevice::WriteOnly));
+    QVERIFY(doc.save(&latin1, -1));
+    QVERIFY(latin1.data().endsWith("<r>caf\xe9</r>"));
+    QDomDocumentCompat again;
+    QVERIFY(setContentBytes(again, latin1.data()));
+    QVERIFY(again.toString(-1) == expected);
+
+    //an encoding that can't be written fails before any output
+    QVERIFY(doc.setContent(QStringView(u"<?xml version='1.0' encoding='x-no-such-encoding'?><r/>"), true));
+    QBuffer unknown;
+    QVERIFY(unknown.open(QIODevice::WriteOnly));
+    QVERIFY(!doc.save(&unknown, -1, &errorMsg));
+    QVERIFY2(errorMsg.contains("x-no-such-encoding"), errorMsg.toUtf8());
+    QVERIFY(unknown.data().isEmpty());
+}
+
+bool QDomDocumentCompatTest::setContentUseSimpleReader(QDomDocumentCompat &doc, const QString &xml) const
+{
+    QString errorMsg;
+    int errorLine = 0;
+    int errorColumn = 0;
+    QXmlInputSource xmlsource;
+    QXmlSimpleReader xmlreader;
+
+    xmlsource.setData(xml);
+    if(!doc.setContent(&xmlsource, &xmlreader, &errorMsg, &errorLine, &errorColumn)){
+        qDebug().noquote().nospace() << (errorMsg + ", Line=" + QString::number(errorLine) + ", Column=" + QString::number(errorColumn));
+        return false;
+    }
+    return true;
+}
 
 QString QDomDocumentCompatTest::toStringUseSimpleReader(const QString &xml, const int indent) const
 {
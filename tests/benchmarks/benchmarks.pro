@@ -0,0 +1,21 @@
+QT += testlib xmlcompat xml
+QT -= gui
+greaterThan(QT_MAJOR_VERSION, 5) {
+QT += core5compat
+}
+
+CONFIG += qt console warn_on depend_includepath
+CONFIG -= app_bundle cmake
+
+TEMPLATE = app
+
+SOURCES +=  tst_qdomdocumentcompatbenchmark.cpp
+
+DEFINES += QDOMDOCUMENTCOMPAT_LIBRARY_TEST
+
+# The in-memory gzip baseline of benchmark_compressed, with the zlib the library uses
+!no_zlib:packagesExist(zlib) {
+CONFIG += link_pkgconfig
+PKGCONFIG += zlib
+DEFINES += QTXMLCOMPAT_ZLIB
+}
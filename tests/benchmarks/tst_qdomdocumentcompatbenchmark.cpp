@@ -0,0 +1,707 @@
+#include <QBuffer>
+#include <QFile>
+#include <QMutex>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtTest>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HEAP_IN_USE
+#endif
+
+#ifdef QTXMLCOMPAT_ZLIB
+#include <zlib.h>
+#endif
+
+#include "qdomdocumentcompat.h"
+
+//Elements per generated document.
+static const int Elements = 100;
+//Items of the document used for the input benchmarks, about 1MB of UTF-8.
+static const int InputItems = 20000;
+
+class QDomDocumentCompatBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    QDomDocumentCompatBenchmark();
+    ~QDomDocumentCompatBenchmark();
+
+private slots:
+    void benchmark_attributes_data();
+    void benchmark_attributes();
+    void benchmark_input_data();
+    void benchmark_input();
+    void benchmark_inputMemory_data();
+    void benchmark_inputMemory();
+    void benchmark_compactTextMemory_data();
+    void benchmark_compactTextMemory();
+    void benchmark_save_data();
+    void benchmark_save();
+    void benchmark_frozen_data();
+    void benchmark_frozen();
+    void benchmark_records_data();
+    void benchmark_records();
+    void benchmark_recordsMemory_data();
+    void benchmark_recordsMemory();
+    void benchmark_compressed_data();
+    void benchmark_compressed();
+    void benchmark_compressedMemory_data();
+    void benchmark_compressedMemory();
+
+private:
+    QString attributes(int count) const;
+    QString items() const;
+    QString payloads() const;
+    QString records() const;
+    bool setContentFrom(QDomDocumentCompat &doc, const QString &input, const QString &xml, const QByteArray &data) const;
+    bool setContent(QDomDocumentCompat &doc, const QString &xml, bool namespaces) const;
+    int processRecords(const QByteArray &data, int threads, const std::function<void()> &sample = std::function<void()>()) const;
+    bool writeInput(const QString &dir, const QString &mode) const;
+    bool roundTrip(const QString &dir, const QString &mode, const std::function<void()> &sample = std::function<void()>()) const;
+#ifdef QTXMLCOMPAT_ZLIB
+    static QByteArray inflateWhole(const QByteArray &data);
+    static QByteArray deflateWhole(const QByteArray &data);
+#endif
+};
+
+QDomDocumentCompatBenchmark::QDomDocumentCompatBenchmark()
+{
+
+}
+
+QDomDocumentCompatBenchmark::~QDomDocumentCompatBenchmark()
+{
+
+}
+
+void QDomDocumentCompatBenchmark::benchmark_attributes_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<QString>("mode");
+
+    const QList<int> counts = QList<int>() << 10 << 100 << 1000;
+    for(int count: counts){
+        //setAttributeNS() per attribute, what setContent() did before
+        QTest::newRow(qPrintable(QStringLiteral("%1 setAttributeNS").arg(count))) << count << QStringLiteral("setAttributeNS");
+        QTest::newRow(qPrintable(QStringLiteral("%1 setContent").arg(count))) << count << QStringLiteral("setContent");
+        QTest::newRow(qPrintable(QStringLiteral("%1 save").arg(count))) << count << QStringLiteral("save");
+    }
+}
+
+void QDomDocumentCompatBenchmark::benchmark_attributes()
+{
+    QFETCH(int, count);
+    QFETCH(QString, mode);
+
+    const QString xml = attributes(count);
+    QDomDocumentCompat doc;
+    QVERIFY(setContent(doc, xml, true));
+
+    if(mode == QLatin1String("setAttributeNS")){
+        QBENCHMARK{
+            QDomDocument built;
+            QDomElement root = built.createElementNS(QStringLiteral("urn:root"), QStringLiteral("root"));
+            built.appendChild(root);
+            for(int j=0; j<Elements; j++){
+                QDomElement item = built.createElementNS(QStringLiteral("urn:root"), QStringLiteral("item"));
+                for(int i=0; i<count; i++){
+                    if(i % 2 == 0){
+                        item.setAttributeNS(QStringLiteral("urn:p"), QStringLiteral("p:a%1").arg(i), QStringLiteral("v%1").arg(j));
+                    }else{
+                        item.setAttributeNS(QString(), QStringLiteral("a%1").arg(i), QStringLiteral("v%1").arg(j));
+                    }
+                }
+                root.appendChild(item);
+            }
+        }
+    }else if(mode == QLatin1String("setContent")){
+        QBENCHMARK{
+            setContent(doc, xml, true);
+        }
+    }else{
+        QString str;
+        QBENCHMARK{
+            str = doc.toString(-1);
+        }
+        QVERIFY(str.length() >= xml.length() / 2);
+    }
+}
+
+void QDomDocumentCompatBenchmark::benchmark_input_data()
+{
+    QTest::addColumn<QString>("input");
+
+    //QXmlInputSource::setData() keeps a full UTF-16 copy for the parse
+    QTest::newRow("setData(QByteArray)") << QStringLiteral("setData(QByteArray)");
+    QTest::newRow("setData(QStringView::toString())") << QStringLiteral("setData(QStringView::toString())");
+    //read in place
+    QTest::newRow("setContent(bytes)") << QStringLiteral("setContent(bytes)");
+    QTest::newRow("setContent(QStringView)") << QStringLiteral("setContent(QStringView)");
+}
+
+void QDomDocumentCompatBenchmark::benchmark_input()
+{
+    QFETCH(QString, input);
+
+    const QString xml = items();
+    const QByteArray data = xml.toUtf8();
+    QDomDocumentCompat doc;
+    QVERIFY(setContentFrom(doc, input, xml, data));
+
+    QBENCHMARK{
+        setContentFrom(doc, input, xml, data);
+    }
+}
+
+void QDomDocumentCompatBenchmark::benchmark_inputMemory_data()
+{
+    benchmark_input_data();
+}
+
+//Heap in use once the tree is built, with the input source still alive: the tree plus any copy of the input.
+void QDomDocumentCompatBenchmark::benchmark_inputMemory()
+{
+#ifdef HEAP_IN_USE
+    QFETCH(QString, input);
+
+    const QString xml = items();
+    const QByteArray data = xml.toUtf8();
+    QDomDocumentCompat doc;
+
+    const struct mallinfo2 before = mallinfo2();
+    QVERIFY(setContentFrom(doc, input, xml, data));
+    const struct mallinfo2 after = mallinfo2();
+
+    const qreal bytes = qreal(after.uordblks + after.hblkhd) - qreal(before.uordblks + before.hblkhd);
+    QTest::setBenchmarkResult(bytes, QTest::BytesAllocated);
+#else
+    QSKIP("needs mallinfo2() of glibc 2.33 or later");
+#endif
+}
+
+void QDomDocumentCompatBenchmark::benchmark_compactTextMemory_data()
+{
+    QTest::addColumn<int>("threshold");
+
+    QTest::newRow("UTF-16 text") << 0;
+    QTest::newRow("compact text") << 256;
+}
+
+//Heap in use once the tree of base64 payloads is built. The bytes are read in place, so no copy
+//of the input adds to it and this is about the peak of the parse.
+void QDomDocumentCompatBenchmark::benchmark_compactTextMemory()
+{
+#ifdef HEAP_IN_USE
+    QFETCH(int, threshold);
+
+    const QByteArray data = payloads().toUtf8();
+    QDomDocumentCompat doc;
+    doc.setCompactTextThreshold(threshold);
+
+    const struct mallinfo2 before = mallinfo2();
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    QVERIFY(doc.setContent(QByteArrayView(data), true));
+#else
+    QVERIFY(doc.setContent(data.constData(), data.size(), true));
+#endif
+    const struct mallinfo2 after = mallinfo2();
+
+    const qreal bytes = qreal(after.uordblks + after.hblkhd) - qreal(before.uordblks + before.hblkhd);
+    QTest::setBenchmarkResult(bytes, QTest::BytesAllocated);
+#else
+    QSKIP("needs mallinfo2() of glibc 2.33 or later");
+#endif
+}
+
+void QDomDocumentCompatBenchmark::benchmark_save_data()
+{
+    QTest::addColumn<int>("indent");
+    QTest::addColumn<bool>("namespaces");
+    QTest::addColumn<bool>("compat");
+
+    const QList<int> indents = QList<int>() << -1 << 0 << 2;
+    for(int indent: indents){
+        QTest::newRow(qPrintable(QStringLiteral("indent %1 namespaces").arg(indent))) << indent << true << true;
+        QTest::newRow(qPrintable(QStringLiteral("indent %1 no namespaces").arg(indent))) << indent << false << true;
+        //QDomDocument::toString() for reference
+        QTest::newRow(qPrintable(QStringLiteral("indent %1 QDomDocument").arg(indent))) << indent << true << false;
+    }
+}
+
+void QDomDocumentCompatBenchmark::benchmark_save()
+{
+    QFETCH(int, indent);
+    QFETCH(bool, namespaces);
+    QFETCH(bool, compat);
+
+    QDomDocumentCompat doc;
+    QVERIFY(setContent(doc, records(), namespaces));
+    const QDomDocument &base = doc;
+
+    QString str;
+    if(compat){
+        QBENCHMARK{
+            str = doc.toString(indent);
+        }
+    }else{
+        QBENCHMARK{
+            str = base.toString(indent);
+        }
+    }
+    QVERIFY(!str.isEmpty());
+}
+
+void QDomDocumentCompatBenchmark::benchmark_frozen_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::addColumn<bool>("frozen");
+
+    const QList<int> counts = QList<int>() << 1 << 2 << 4 << 8;
+    for(int threads: counts){
+        QTest::newRow(qPrintable(QStringLiteral("%1 frozen").arg(threads))) << threads << true;
+        //one document shared behind a mutex
+        QTest::newRow(qPrintable(QStringLiteral("%1 locked").arg(threads))) << threads << false;
+    }
+}
+
+//Every thread runs the same query and save, so flat times mean the readers scale linearly.
+void QDomDocumentCompatBenchmark::benchmark_frozen()
+{
+    QFETCH(int, threads);
+    QFETCH(bool, frozen);
+
+    QDomDocumentCompat doc;
+    QVERIFY(setContent(doc, records(), true));
+    const QDomCompatFrozenDocument snapshot = doc.freeze();
+    QHash<QString, QString> ns;
+    ns[QStringLiteral("r")] = QStringLiteral("urn:root");
+    const QString expression = QStringLiteral("/r:root/r:record[@kind='a']/r:value");
+
+    QMutex mutex;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QAtomicInt found;
+
+    QBENCHMARK{
+        for(int i=0; i<threads; i++){
+            pool.start(QRunnable::create([&](){
+                int count = 0;
+                if(frozen){
+                    for(const QDomCompatFrozenNode &node: snapshot.select(expression, ns)){
+                        count += node.text().length();
+                    }
+                    count += snapshot.toString(-1).length();
+                }else{
+                    QMutexLocker locker(&mutex);
+                    for(const QDomNode &node: doc.select(expression, ns)){
+                        count += node.toElement().text().length();
+                    }
+                    count += doc.toString(-1).length();
+                }
+                found.fetchAndAddRelaxed(count);
+            }));
+        }
+        pool.waitForDone();
+    }
+    QVERIFY(found.loadRelaxed() > 0);
+}
+
+void QDomDocumentCompatBenchmark::benchmark_records_data()
+{
+    QTest::addColumn<int>("threads");
+
+    //the whole document with setContent(), then a walk over the records
+    QTest::newRow("setContent") << 0;
+    QTest::newRow("processRecords 1 thread") << 1;
+    QTest::newRow("processRecords 4 threads") << 4;
+}
+
+void QDomDocumentCompatBenchmark::benchmark_records()
+{
+    QFETCH(int, threads);
+
+    const QByteArray data = records().toUtf8();
+    int count = 0;
+    QBENCHMARK{
+        count = processRecords(data, threads);
+    }
+    QVERIFY(count == InputItems);
+}
+
+void QDomDocumentCompatBenchmark::benchmark_recordsMemory_data()
+{
+    benchmark_records_data();
+}
+
+//Highest heap in use seen while the records are processed, the whole tree for setContent().
+void QDomDocumentCompatBenchmark::benchmark_recordsMemory()
+{
+#ifdef HEAP_IN_USE
+    QFETCH(int, threads);
+
+    const QByteArray data = records().toUtf8();
+    QMutex mutex;
+    size_t peak = 0;
+    const struct mallinfo2 before = mallinfo2();
+    const int count = processRecords(data, threads, [&](){
+        const struct mallinfo2 now = mallinfo2();
+        QMutexLocker locker(&mutex);
+        peak = qMax(peak, now.uordblks + now.hblkhd);
+    });
+    QVERIFY(count == InputItems);
+
+    const qreal bytes = qreal(peak) - qreal(before.uordblks + before.hblkhd);
+    QTest::setBenchmarkResult(bytes, QTest::BytesAllocated);
+#else
+    QSKIP("needs mallinfo2() of glibc 2.33 or later");
+#endif
+}
+
+void QDomDocumentCompatBenchmark::benchmark_compressed_data()
+{
+    QTest::addColumn<QString>("mode");
+
+    //the file read into memory and toString() written out
+    QTest::newRow("whole") << QStringLiteral("whole");
+#ifdef QTXMLCOMPAT_ZLIB
+    //the same, inflating the whole input and deflating the whole output in memory
+    QTest::newRow("whole gzip") << QStringLiteral("whole gzip");
+#endif
+    QTest::newRow("stream") << QStringLiteral("stream");
+    //inflated, parsed, saved and deflated a chunk at a time
+    QTest::newRow("stream gzip") << QStringLiteral("stream gzip");
+}
+
+//Reads a file of the records document and writes it back to another one.
+void QDomDocumentCompatBenchmark::benchmark_compressed()
+{
+    if(!QDomDocumentCompat::isCompressionSupported()){
+        QSKIP("Built without zlib");
+    }
+    QFETCH(QString, mode);
+
+    QTemporaryDir dir;
+    QVERIFY(writeInput(dir.path(), mode));
+    bool ok = false;
+    QBENCHMARK{
+        ok = roundTrip(dir.path(), mode);
+    }
+    QVERIFY(ok);
+}
+
+void QDomDocumentCompatBenchmark::benchmark_compressedMemory_data()
+{
+    benchmark_compressed_data();
+}
+
+//Highest heap in use between the steps of benchmark_compressed(), the tree plus any full copy of the input or output.
+void QDomDocumentCompatBenchmark::benchmark_compressedMemory()
+{
+#ifdef HEAP_IN_USE
+    if(!QDomDocumentCompat::isCompressionSupported()){
+        QSKIP("Built without zlib");
+    }
+    QFETCH(QString, mode);
+
+    QTemporaryDir dir;
+    QVERIFY(writeInput(dir.path(), mode));
+    size_t peak = 0;
+    const struct mallinfo2 before = mallinfo2();
+    QVERIFY(roundTrip(dir.path(), mode, [&](){
+        const struct mallinfo2 now = mallinfo2();
+        peak = qMax(peak, now.uordblks + now.hblkhd);
+    }));
+
+    const qreal bytes = qreal(peak) - qreal(before.uordblks + before.hblkhd);
+    QTest::setBenchmarkResult(bytes, QTest::BytesAllocated);
+#else
+    QSKIP("needs mallinfo2() of glibc 2.33 or later");
+#endif
+}
+
+//Elements with `count` attributes, every other one in a namespace.
+QString QDomDocumentCompatBenchmark::attributes(int count) const
+{
+    QString xml = QStringLiteral("<root xmlns=\"urn:root\" xmlns:p=\"urn:p\">\n");
+    for(int j=0; j<Elements; j++){
+        xml += QStringLiteral("  <item");
+        for(int i=0; i<count; i++){
+            if(i % 2 == 0){
+                xml += QStringLiteral(" p:a%1=\"v%2\"").arg(i).arg(j);
+            }else{
+                xml += QStringLiteral(" a%1=\"v%2\"").arg(i).arg(j);
+            }
+        }
+        xml += QStringLiteral("/>\n");
+    }
+    xml += QStringLiteral("</root>");
+    return xml;
+}
+
+//Mixed content with some non-ASCII text.
+QString QDomDocumentCompatBenchmark::items() const
+{
+    QString xml = QStringLiteral("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<root>\n");
+    for(int i=0; i<InputItems; i++){
+        xml += QStringLiteral("  <item n=\"%1\">text %1 <b>caf\u00e9</b> \u65e5\u672c</item>\n").arg(i);
+    }
+    xml += QStringLiteral("</root>");
+    return xml;
+}
+
+//Attachments of 4KB of base64 each, about 4MB of UTF-8.
+QString QDomDocumentCompatBenchmark::payloads() const
+{
+    const QString blob = QString::fromLatin1(QByteArray(3 * 1024, 'x').toBase64());
+    QString xml = QStringLiteral("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<root>\n");
+    for(int i=0; i<1000; i++){
+        xml += QStringLiteral("  <attachment n=\"%1\">%2</attachment>\n").arg(i).arg(blob);
+    }
+    xml += QStringLiteral("</root>");
+    return xml;
+}
+
+//Indented records with namespaced and plain attributes, nested elements and text.
+QString QDomDocumentCompatBenchmark::records() const
+{
+    QString xml = QStringLiteral("<root xmlns=\"urn:root\" xmlns:p=\"urn:p\">\n");
+    for(int i=0; i<InputItems; i++){
+        xml += QStringLiteral("  <record p:id=\"%1\" kind=\"a\">\n"
+                              "    <p:name>name %1</p:name>\n"
+                              "    <value unit=\"m\">%1.5</value>\n"
+                              "    <empty/>\n"
+                              "  </record>\n").arg(i);
+    }
+    xml += QStringLiteral("</root>");
+    return xml;
+}
+
+bool QDomDocumentCompatBenchmark::setContentFrom(QDomDocumentCompat &doc, const QString &input, const QString &xml, const QByteArray &data) const
+{
+    if(input == QLatin1String("setContent(bytes)")){
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+        return doc.setContent(QByteArrayView(data), true);
+#else
+        return doc.setContent(data.constData(), data.size(), true);
+#endif
+    }else if(input == QLatin1String("setContent(QStringView)")){
+        return doc.setContent(QStringView(xml), true);
+    }
+
+    QXmlInputSource xmlsource;
+    QXmlSimpleReader xmlreader;
+    if(input == QLatin1String("setData(QByteArray)")){
+        xmlsource.setData(data);
+    }else{
+        xmlsource.setData(QStringView(xml).toString());
+    }
+    return doc.setContent(&xmlsource, &xmlreader);
+}
+
+bool QDomDocumentCompatBenchmark::setContent(QDomDocumentCompat &doc, const QString &xml, bool namespaces) const
+{
+    QXmlInputSource xmlsource;
+    QXmlSimpleReader xmlreader;
+    xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), namespaces);
+    xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), !namespaces);
+    xmlsource.setData(xml);
+    return doc.setContent(&xmlsource, &xmlreader);
+}
+
+//Counts the records, calling `sample` once per record. 0 threads parses the whole document instead.
+int QDomDocumentCompatBenchmark::processRecords(const QByteArray &data, int threads, const std::function<void()> &sample) const
+{
+    QAtomicInt count;
+    if(threads == 0){
+        QDomDocumentCompat doc;
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+        const bool ok = doc.setContent(QByteArrayView(data), true);
+#else
+        const bool ok = doc.setContent(data.constData(), data.size(), true);
+#endif
+        if(!ok){
+            return -1;
+        }
+        for(QDomElement record = doc.documentElement().firstChildElement(); !record.isNull(); record = record.nextSiblingElement()){
+            if(sample){
+                sample();
+            }
+            count.ref();
+        }
+        return count.loadRelaxed();
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QDomCompatRecordOptions options;
+    options.pool = &pool;
+    QByteArray input = data;
+    QBuffer buffer(&input);
+    buffer.open(QIODevice::ReadOnly);
+    QDomDocumentCompat doc;
+    const bool ok = doc.processRecords(&buffer, QStringLiteral("record"), [&](const QDomCompatRecord &record){
+        if(sample){
+            sample();
+        }
+        if(!record.document.documentElement().isNull()){
+            count.ref();
+        }
+    }, options);
+    return ok ? count.loadRelaxed() : -1;
+}
+
+//Writes the records document to `dir`/input, gzip-compressed for the gzip modes.
+bool QDomDocumentCompatBenchmark::writeInput(const QString &dir, const QString &mode) const
+{
+    QDomDocumentCompat doc;
+    if(!setContent(doc, records(), true)){
+        return false;
+    }
+    if(mode.endsWith(QLatin1String("gzip"))){
+        doc.setCompression(QDomDocumentCompat::GzipCompression);
+    }
+    QFile file(dir + QStringLiteral("/input"));
+    return file.open(QIODevice::WriteOnly) && doc.save(&file, -1);
+}
+
+//Parses `dir`/input and saves it to `dir`/output, calling `sample` after each step.
+bool QDomDocumentCompatBenchmark::roundTrip(const QString &dir, const QString &mode, const std::function<void()> &sample) const
+{
+    QFile input(dir + QStringLiteral("/input"));
+    QFile output(dir + QStringLiteral("/output"));
+    if(!input.open(QIODevice::ReadOnly) || !output.open(QIODevice::WriteOnly)){
+        return false;
+    }
+
+    QDomDocumentCompat doc;
+    if(mode.startsWith(QLatin1String("whole"))){
+        const bool compressed = mode.endsWith(QLatin1String("gzip"));
+        const QByteArray raw = input.readAll();
+        if(sample){
+            sample();
+        }
+#ifdef QTXMLCOMPAT_ZLIB
+        const QByteArray data = compressed ? inflateWhole(raw) : raw;
+#else
+        const QByteArray data = compressed ? QByteArray() : raw;
+#endif
+        if(data.isEmpty()){
+            return false;
+        }
+        if(sample && compressed){
+            sample();
+        }
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+        const bool ok = doc.setContent(QByteArrayView(data), true);
+#else
+        const bool ok = doc.setContent(data.constData(), data.size(), true);
+#endif
+        if(!ok){
+            return false;
+        }
+        if(sample){
+            sample();
+        }
+        const QString str = doc.toString(-1);
+        const QByteArray utf8 = str.toUtf8();
+        if(sample){
+            sample();
+        }
+#ifdef QTXMLCOMPAT_ZLIB
+        const QByteArray bytes = compressed ? deflateWhole(utf8) : utf8;
+#else
+        const QByteArray bytes = utf8;
+#endif
+        if(bytes.isEmpty()){
+            return false;
+        }
+        if(sample && compressed){
+            sample();
+        }
+        return output.write(bytes) == bytes.size();
+    }
+
+    if(mode.endsWith(QLatin1String("gzip"))){
+        doc.setCompression(QDomDocumentCompat::GzipCompression);
+    }
+    if(!doc.setContent(&input, true)){
+        return false;
+    }
+    if(sample){
+        sample();
+    }
+    const bool ok = doc.save(&output, -1);
+    if(sample){
+        sample();
+    }
+    return ok;
+}
+
+#ifdef QTXMLCOMPAT_ZLIB
+//Inflates a whole gzip file held in memory, empty on error.
+QByteArray QDomDocumentCompatBenchmark::inflateWhole(const QByteArray &data)
+{
+    z_stream z;
+    z.zalloc = Z_NULL;
+    z.zfree = Z_NULL;
+    z.opaque = Z_NULL;
+    z.next_in = Z_NULL;
+    z.avail_in = 0;
+    if(inflateInit2(&z, 15 + 16) != Z_OK){
+        return QByteArray();
+    }
+
+    QByteArray out(qMax(int(data.size()) * 4, 4096), Qt::Uninitialized);
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    z.avail_in = uInt(data.size());
+    int ret = Z_OK;
+    while(ret == Z_OK){
+        if(z.total_out == uLong(out.size())){
+            out.resize(out.size() * 2);
+        }
+        z.next_out = reinterpret_cast<Bytef *>(out.data()) + z.total_out;
+        z.avail_out = uInt(uLong(out.size()) - z.total_out);
+        ret = inflate(&z, Z_NO_FLUSH);
+    }
+    const uLong size = z.total_out;
+    inflateEnd(&z);
+    if(ret != Z_STREAM_END){
+        return QByteArray();
+    }
+    out.resize(int(size));
+    return out;
+}
+
+//Deflates `data` into one gzip member in a single call, empty on error.
+QByteArray QDomDocumentCompatBenchmark::deflateWhole(const QByteArray &data)
+{
+    z_stream z;
+    z.zalloc = Z_NULL;
+    z.zfree = Z_NULL;
+    z.opaque = Z_NULL;
+    if(deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+        return QByteArray();
+    }
+
+    QByteArray out(int(deflateBound(&z, uLong(data.size()))), Qt::Uninitialized);
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    z.avail_in = uInt(data.size());
+    z.next_out = reinterpret_cast<Bytef *>(out.data());
+    z.avail_out = uInt(out.size());
+    const int ret = deflate(&z, Z_FINISH);
+    const uLong size = z.total_out;
+    deflateEnd(&z);
+    if(ret != Z_STREAM_END){
+        return QByteArray();
+    }
+    out.resize(int(size));
+    return out;
+}
+#endif
+
+QTEST_APPLESS_MAIN(QDomDocumentCompatBenchmark)
+
+#include "tst_qdomdocumentcompatbenchmark.moc"
@@ -0,0 +1,248 @@
+#include <QtTest>
+
+#include <cmath>
+
+#include "qdomdocumentcompat.h"
+
+//Growth exponent above which a shape is reported as super-linear (linear = 1.0, quadratic = 2.0).
+static const double MaxExponent = 1.5;
+//Number of doubling steps measured per shape.
+static const int Steps = 5;
+
+class QDomDocumentCompatComplexityTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    QDomDocumentCompatComplexityTest();
+    ~QDomDocumentCompatComplexityTest();
+
+private slots:
+    void test_growth_data();
+    void test_growth();
+
+private:
+    QString generate(const QString &shape, int size) const;
+    double measure(const QString &xml, bool namespaces, bool save, bool *ok) const;
+    double exponent(const QList<int> &sizes, const QList<double> &times) const;
+};
+
+QDomDocumentCompatComplexityTest::QDomDocumentCompatComplexityTest()
+{
+
+}
+
+QDomDocumentCompatComplexityTest::~QDomDocumentCompatComplexityTest()
+{
+
+}
+
+void QDomDocumentCompatComplexityTest::test_growth_data()
+{
+    QTest::addColumn<QString>("shape");
+    QTest::addColumn<int>("base");
+    QTest::addColumn<bool>("namespaces");
+
+    QTest::newRow("wide") << QStringLiteral("wide") << 1000 << true;
+    //keep the recursion of save() well inside a 1MB stack
+    QTest::newRow("deep") << QStringLiteral("deep") << 125 << true;
+    QTest::newRow("attributes") << QStringLiteral("attributes") << 32 << false;
+    //setAttributeNS() builds the first element of a shape at O(A^2), so grow the element count
+    //with the attribute count: cloning keeps the total linear, rebuilding each element would not
+    QTest::newRow("attributes namespaces") << QStringLiteral("attribute grid") << 1024 << true;
+    QTest::newRow("namespaces") << QStringLiteral("namespaces") << 1000 << true;
+    QTest::newRow("text") << QStringLiteral("text") << 4000 << true;
+    QTest::newRow("dtd") << QStringLiteral("dtd") << 1000 << true;
+}
+
+void QDomDocumentCompatComplexityTest::test_growth()
+{
+    QFETCH(QString, shape);
+    QFETCH(int, base);
+    QFETCH(bool, namespaces);
+
+    QList<int> sizes;
+    QList<double> parse_times;
+    QList<double> save_times;
+    QString detail;
+
+    for(int i=0; i<Steps; i++){
+        const int size = base << i;
+        const QString xml = generate(shape, size);
+        bool ok = false;
+
+        sizes.append(size);
+        parse_times.append(measure(xml, namespaces, false, &ok));
+        QVERIFY2(ok, qPrintable(QStringLiteral("parse error: %1 %2").arg(shape).arg(size)));
+        save_times.append(measure(xml, namespaces, true, &ok));
+        QVERIFY2(ok, qPrintable(QStringLiteral("parse error: %1 %2").arg(shape).arg(size)));
+
+        detail += QStringLiteral("\n  n=%1 setContent=%2ms save=%3ms")
+                .arg(size)
+                .arg(parse_times.last() / 1000000.0, 0, 'f', 3)
+                .arg(save_times.last() / 1000000.0, 0, 'f', 3);
+    }
+
+    const double parse_exponent = exponent(sizes, parse_times);
+    const double save_exponent = exponent(sizes, save_times);
+    const QString message = QStringLiteral("%1: setContent() grows as n^%2, save() as n^%3")
+            .arg(shape)
+            .arg(parse_exponent, 0, 'f', 2)
+            .arg(save_exponent, 0, 'f', 2) + detail;
+
+    QVERIFY2(parse_exponent < MaxExponent, qPrintable(message));
+    QVERIFY2(save_exponent < MaxExponent, qPrintable(message));
+}
+
+QString QDomDocumentCompatComplexityTest::generate(const QString &shape, int size) const
+{
+    QString xml;
+
+    if(shape == QLatin1String("wide")){
+        xml += QStringLiteral("<root>\n");
+        for(int i=0; i<size; i++){
+            xml += QStringLiteral("  <item n=\"%1\">text %1</item>\n").arg(i);
+        }
+        xml += QStringLiteral("</root>");
+
+    }else if(shape == QLatin1String("deep")){
+        for(int i=0; i<size; i++){
+            xml += QStringLiteral("<e n=\"%1\"> ").arg(i);
+        }
+        xml += QStringLiteral("leaf");
+        for(int i=0; i<size; i++){
+            xml += QStringLiteral("</e>");
+        }
+
+    }else if(shape == QLatin1String("attributes")){
+        xml += QStringLiteral("<root>\n");
+        for(int j=0; j<32; j++){
+            xml += QStringLiteral("  <item");
+            for(int i=0; i<size; i++){
+                xml += QStringLiteral(" a%1=\"v%1\"").arg(i);
+            }
+            xml += QStringLiteral("/>\n");
+        }
+        xml += QStringLiteral("</root>");
+
+    }else if(shape == QLatin1String("attribute grid")){
+        //size attributes in total, as sqrt(size) elements of sqrt(size) attributes each
+        const int side = int(std::sqrt(double(size)));
+        xml += QStringLiteral("<root xmlns:p=\"urn:p\">\n");
+        for(int j=0; j<side; j++){
+            xml += QStringLiteral("  <item");
+            for(int i=0; i<side; i++){
+                xml += QStringLiteral(" p:a%1=\"v%2\"").arg(i).arg(j);
+            }
+            xml += QStringLiteral("/>\n");
+        }
+        xml += QStringLiteral("</root>");
+
+    }else if(shape == QLatin1String("namespaces")){
+        xml += QStringLiteral("<root xmlns=\"urn:root\">\n");
+        for(int i=0; i<size; i++){
+            xml += QStringLiteral("  <p%1:item xmlns:p%1=\"urn:ns%1\" p%1:a=\"v\">text</p%1:item>\n").arg(i);
+        }
+        xml += QStringLiteral("</root>");
+
+    }else if(shape == QLatin1String("text")){
+        xml += QStringLiteral("<root>");
+        for(int i=0; i<size; i++){
+            xml += QStringLiteral("lorem ipsum dolor sit amet %1\n").arg(i);
+        }
+        xml += QStringLiteral("</root>");
+
+    }else if(shape == QLatin1String("dtd")){
+        xml += QStringLiteral("<?xml version='1.0' encoding='UTF-8'?>\n"
+                              "<!DOCTYPE root [\n"
+                              "<!ELEMENT root (item*)>\n"
+                              "<!ELEMENT item (#PCDATA)>\n"
+                              "<!ATTLIST item n CDATA #REQUIRED>\n"
+                              "<!NOTATION EARLY PUBLIC \"Born early\">\n"
+                              "<!ENTITY camp \"YURUCAMP\">\n"
+                              "]>\n"
+                              "<root>\n");
+        for(int i=0; i<size; i++){
+            xml += QStringLiteral("  <item n=\"%1\">&camp; %1</item>\n").arg(i);
+        }
+        xml += QStringLiteral("</root>");
+    }
+
+    return xml;
+}
+
+//Returns the best of three averaged batches in nanoseconds, each batch running for at least 20ms.
+double QDomDocumentCompatComplexityTest::measure(const QString &xml, bool namespaces, bool save, bool *ok) const
+{
+    const qint64 min_batch = 20 * 1000 * 1000;
+    double best = -1;
+    *ok = true;
+
+    for(int batch=0; batch<3; batch++){
+        QElapsedTimer timer;
+        qint64 elapsed = 0;
+        int count = 0;
+
+        QDomDocumentCompat doc;
+        while(count == 0 || elapsed < min_batch){
+            if(!save || count == 0){
+                QXmlInputSource xmlsource;
+                QXmlSimpleReader xmlreader;
+                xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), namespaces);
+                xmlreader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), !namespaces);
+                xmlsource.setData(xml);
+
+                timer.start();
+                if(!doc.setContent(&xmlsource, &xmlreader)){
+                    *ok = false;
+                    return -1;
+                }
+                if(!save){
+                    elapsed += timer.nsecsElapsed();
+                }
+            }
+            if(save){
+                timer.start();
+                const QString str = doc.toString(-1);
+                elapsed += timer.nsecsElapsed();
+                if(str.isEmpty()){
+                    *ok = false;
+                    return -1;
+                }
+            }
+            count++;
+        }
+
+        const double average = double(elapsed) / count;
+        if(best < 0 || average < best){
+            best = average;
+        }
+    }
+
+    return best;
+}
+
+//Least squares slope of log(time) over log(size).
+double QDomDocumentCompatComplexityTest::exponent(const QList<int> &sizes, const QList<double> &times) const
+{
+    double sum_x = 0;
+    double sum_y = 0;
+    double sum_xx = 0;
+    double sum_xy = 0;
+    const int n = sizes.length();
+
+    for(int i=0; i<n; i++){
+        const double x = std::log(double(sizes.at(i)));
+        const double y = std::log(qMax(times.at(i), 1.0));
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+}
+
+QTEST_APPLESS_MAIN(QDomDocumentCompatComplexityTest)
+
+#include "tst_qdomdocumentcompatcomplexity.moc"
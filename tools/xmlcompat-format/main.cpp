@@ -0,0 +1,283 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <cstdio>
+
+#include "qdomdocumentcompat.h"
+
+struct FormatOptions {
+    int indent;
+    bool namespaceProcessing;
+    bool inPlace;
+    bool quiet;
+};
+
+struct FormatJob {
+    QString inputPath;
+    QString outputPath;
+};
+
+class FormatReporter
+{
+public:
+    explicit FormatReporter(bool quiet)
+        : out(stdout)
+        , err(stderr)
+        , quiet(quiet)
+        , files(0)
+        , failures(0)
+        , bytes(0)
+    {
+    }
+
+    void succeeded(const FormatJob &job, qint64 size, qint64 nsecs)
+    {
+        QMutexLocker locker(&mutex);
+        files++;
+        bytes += size;
+        if(!quiet){
+            out << QString::number(nsecs / 1000000.0, 'f', 2).rightJustified(10) << QStringLiteral(" ms ")
+                << QString::number(size).rightJustified(12) << QStringLiteral(" bytes  ")
+                << QDir::toNativeSeparators(job.inputPath) << Qt::endl;
+        }
+    }
+
+    void failed(const FormatJob &job, const QString &message)
+    {
+        QMutexLocker locker(&mutex);
+        files++;
+        failures++;
+        err << QDir::toNativeSeparators(job.inputPath) << QStringLiteral(": ") << message << Qt::endl;
+    }
+
+    void summary(qint64 nsecs)
+    {
+        QMutexLocker locker(&mutex);
+        const double seconds = nsecs / 1000000000.0;
+        out << files << QStringLiteral(" file(s), ") << failures << QStringLiteral(" failed, ")
+            << bytes << QStringLiteral(" bytes in ") << QString::number(seconds, 'f', 3) << QStringLiteral(" s");
+        if(seconds > 0){
+            out << QStringLiteral(" (") << QString::number(files / seconds, 'f', 1) << QStringLiteral(" files/s, ")
+                << QString::number(bytes / seconds / (1024.0 * 1024.0), 'f', 2) << QStringLiteral(" MiB/s)");
+        }
+        out << Qt::endl;
+    }
+
+    int failureCount()
+    {
+        QMutexLocker locker(&mutex);
+        return failures;
+    }
+
+private:
+    QMutex mutex;
+    QTextStream out;
+    QTextStream err;
+    bool quiet;
+    int files;
+    int failures;
+    qint64 bytes;
+};
+
+class FormatTask : public QRunnable
+{
+public:
+    FormatTask(const FormatJob &job, const FormatOptions &options, FormatReporter *reporter)
+        : job(job)
+        , options(options)
+        , reporter(reporter)
+    {
+    }
+
+    void run() override
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        QString errorMsg;
+        int errorLine = 0;
+        int errorColumn = 0;
+        qint64 size = 0;
+
+        //parse (the document is the only per-file allocation that grows with the input)
+        QDomDocumentCompat doc;
+        {
+            QFile file(job.inputPath);
+            if(!file.open(QIODevice::ReadOnly)){
+                reporter->failed(job, file.errorString());
+                return;
+            }
+            size = file.size();
+
+            QXmlInputSource source(&file);
+            QXmlSimpleReader reader;
+            reader.setFeature(QStringLiteral("http://xml.org/sax/features/namespaces"), options.namespaceProcessing);
+            reader.setFeature(QStringLiteral("http://xml.org/sax/features/namespace-prefixes"), !options.namespaceProcessing);
+            if(!doc.setContent(&source, &reader, &errorMsg, &errorLine, &errorColumn)){
+                reporter->failed(job, QStringLiteral("%1, Line=%2, Column=%3").arg(errorMsg).arg(errorLine).arg(errorColumn));
+                return;
+            }
+        }
+
+        //save (streamed through QTextStream's buffer, never held as a whole string)
+        QDir().mkpath(QFileInfo(job.outputPath).absolutePath());
+        QSaveFile file(job.outputPath);
+        if(!file.open(QIODevice::WriteOnly)){
+            reporter->failed(job, file.errorString());
+            return;
+        }
+        {
+            QTextStream out(&file);
+#if (QT_VERSION < QT_VERSION_CHECK(6, 0, 0))
+            out.setCodec("UTF-8");
+#endif
+            doc.save(out, options.indent);
+            out.flush();
+            if(out.status() != QTextStream::Ok){
+                file.cancelWriting();
+                reporter->failed(job, QStringLiteral("Write error"));
+                return;
+            }
+        }
+        if(!file.commit()){
+            reporter->failed(job, file.errorString());
+            return;
+        }
+
+        reporter->succeeded(job, size, timer.nsecsElapsed());
+    }
+
+private:
+    FormatJob job;
+    FormatOptions options;
+    FormatReporter *reporter;
+};
+
+static QString outputPathFor(const QString &inputPath, const QString &root, const FormatOptions &options, const QString &outputDir)
+{
+    if(options.inPlace){
+        return inputPath;
+    }
+    if(root.isEmpty()){
+        return QDir(outputDir).filePath(QFileInfo(inputPath).fileName());
+    }
+    return QDir(outputDir).filePath(QDir(root).relativeFilePath(inputPath));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("xmlcompat-format"));
+    QCoreApplication::setApplicationVersion(QStringLiteral("1.0.0"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Reformat XML/HTML files with QDomDocumentCompat, keeping whitespace text nodes."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument(QStringLiteral("paths"), QStringLiteral("Files or directories to process."), QStringLiteral("paths..."));
+
+    QCommandLineOption indentOption(QStringList() << QStringLiteral("i") << QStringLiteral("indent"),
+                                    QStringLiteral("Indent passed to save(): -1 keeps the layout as is, 0 adds newlines only (default: -1)."),
+                                    QStringLiteral("n"), QStringLiteral("-1"));
+    QCommandLineOption noNamespacesOption(QStringList() << QStringLiteral("no-namespaces"),
+                                          QStringLiteral("Disable namespace processing in the reader."));
+    QCommandLineOption inPlaceOption(QStringList() << QStringLiteral("in-place"),
+                                     QStringLiteral("Overwrite the input files."));
+    QCommandLineOption outputDirOption(QStringList() << QStringLiteral("o") << QStringLiteral("output-dir"),
+                                       QStringLiteral("Write the results below <dir>, mirroring the input directory trees."),
+                                       QStringLiteral("dir"));
+    QCommandLineOption filterOption(QStringList() << QStringLiteral("f") << QStringLiteral("filter"),
+                                    QStringLiteral("Comma separated file name patterns used inside directories (default: *.xml,*.rels,*.html,*.htm,*.xhtml)."),
+                                    QStringLiteral("patterns"), QStringLiteral("*.xml,*.rels,*.html,*.htm,*.xhtml"));
+    QCommandLineOption jobsOption(QStringList() << QStringLiteral("j") << QStringLiteral("jobs"),
+                                  QStringLiteral("Number of files processed in parallel (default: number of cores)."),
+                                  QStringLiteral("n"), QString::number(QThread::idealThreadCount()));
+    QCommandLineOption quietOption(QStringList() << QStringLiteral("q") << QStringLiteral("quiet"),
+                                   QStringLiteral("Only print errors and the summary."));
+    parser.addOption(indentOption);
+    parser.addOption(noNamespacesOption);
+    parser.addOption(inPlaceOption);
+    parser.addOption(outputDirOption);
+    parser.addOption(filterOption);
+    parser.addOption(jobsOption);
+    parser.addOption(quietOption);
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    bool ok = false;
+    FormatOptions options;
+    options.indent = parser.value(indentOption).toInt(&ok);
+    if(!ok || options.indent < -1){
+        err << QStringLiteral("Invalid indent: ") << parser.value(indentOption) << Qt::endl;
+        return 2;
+    }
+    const int jobs = parser.value(jobsOption).toInt(&ok);
+    if(!ok || jobs < 1){
+        err << QStringLiteral("Invalid number of jobs: ") << parser.value(jobsOption) << Qt::endl;
+        return 2;
+    }
+    options.namespaceProcessing = !parser.isSet(noNamespacesOption);
+    options.inPlace = parser.isSet(inPlaceOption);
+    options.quiet = parser.isSet(quietOption);
+    const QString outputDir = parser.value(outputDirOption);
+    if(options.inPlace == !outputDir.isEmpty()){
+        err << QStringLiteral("Specify either --in-place or --output-dir.") << Qt::endl;
+        return 2;
+    }
+    if(parser.positionalArguments().isEmpty()){
+        parser.showHelp(2);
+    }
+
+    const QStringList filters = parser.value(filterOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+
+    QList<FormatJob> list;
+    for(const QString &path: parser.positionalArguments()){
+        QFileInfo info(path);
+        if(info.isDir()){
+            const QString root = info.absoluteFilePath();
+            QDirIterator it(root, filters, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+            while(it.hasNext()){
+                FormatJob job;
+                job.inputPath = it.next();
+                job.outputPath = outputPathFor(job.inputPath, root, options, outputDir);
+                list.append(job);
+            }
+        }else if(info.isFile()){
+            FormatJob job;
+            job.inputPath = info.absoluteFilePath();
+            job.outputPath = outputPathFor(job.inputPath, QString(), options, outputDir);
+            list.append(job);
+        }else{
+            err << QStringLiteral("No such file or directory: ") << path << Qt::endl;
+            return 2;
+        }
+    }
+
+    FormatReporter reporter(options.quiet);
+    QElapsedTimer timer;
+    timer.start();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+    for(const FormatJob &job: list){
+        pool.start(new FormatTask(job, options, &reporter));
+    }
+    pool.waitForDone();
+
+    reporter.summary(timer.nsecsElapsed());
+
+    return reporter.failureCount() > 0 ? 1 : 0;
+}
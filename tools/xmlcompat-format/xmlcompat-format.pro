@@ -0,0 +1,12 @@
+QT = core xml xmlcompat
+greaterThan(QT_MAJOR_VERSION, 5) {
+QT += core5compat
+}
+
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp
+
+QMAKE_TARGET_DESCRIPTION = "QtXmlCompat Formatter"
+load(qt_app)